@@ -0,0 +1,34 @@
+// child holds a lock and waits on a semaphore nobody posts while its parent
+// waits on the lock, selfie reports the deadlock with its wait-for graph
+
+uint64_t *lock;
+uint64_t *ready;
+uint64_t *never;
+
+uint64_t main() {
+  lock  = malloc(sizeof(uint64_t));
+  ready = malloc(sizeof(uint64_t));
+  never = malloc(sizeof(uint64_t));
+
+  lock_init(lock);
+  sem_init(ready, 0);
+  sem_init(never, 0);
+
+  if (fork() == 0) {
+    lock_acquire(lock);
+
+    sem_post(ready);
+    sem_wait(never);
+
+    lock_release(lock);
+
+    exit(0);
+  }
+
+  // make sure the child holds the lock
+  sem_wait(ready);
+
+  lock_acquire(lock);
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+// mix of CPU-bound and I/O-bound processes for comparing schedulers,
+// see per-context turnaround and response to I/O in selfie's profile
+
+uint64_t CPU_BOUND = 3;
+uint64_t IO_BOUND  = 3;
+
+// CPU-bound processes compute without system calls
+uint64_t compute(uint64_t n) {
+  uint64_t i;
+
+  i = 0;
+
+  while (i < n)
+    i = i + 1;
+
+  return i;
+}
+
+// I/O-bound processes compute briefly between many short writes
+uint64_t interact(uint64_t n) {
+  uint64_t i;
+
+  i = 0;
+
+  while (i < n) {
+    compute(100);
+
+    // write nothing to keep output clean
+    write(1, "", 0);
+
+    i = i + 1;
+  }
+
+  return i;
+}
+
+uint64_t main() {
+  uint64_t i;
+
+  i = 0;
+
+  while (i < CPU_BOUND) {
+    if (fork() == 0) {
+      compute(1000000);
+
+      exit(0);
+    }
+
+    i = i + 1;
+  }
+
+  i = 0;
+
+  while (i < IO_BOUND) {
+    if (fork() == 0) {
+      interact(200);
+
+      exit(0);
+    }
+
+    i = i + 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,25 @@
+// CPU-bound processes with 1:2:3:4 tickets for stride scheduling, run with
+// an instruction budget and compare tickets with CPU shares in selfie's profile
+
+uint64_t PROCESSES = 4;
+uint64_t TICKETS   = 100;
+
+uint64_t main() {
+  uint64_t i;
+
+  i = 1;
+
+  while (i <= PROCESSES) {
+    if (fork() == 0) {
+      tickets(i * TICKETS);
+
+      // spin until the instruction budget is exhausted
+      while (1)
+        i = i + 1;
+    }
+
+    i = i + 1;
+  }
+
+  return 0;
+}
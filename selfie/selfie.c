@@ -1119,6 +1119,7 @@ void emit_string_data(uint64_t *entry);
 void finalize_data_segment();
 
 uint64_t *touch(uint64_t *memory, uint64_t bytes);
+uint64_t *allocate_page_aligned(uint64_t bytes);
 
 uint64_t *allocate_elf_header();
 
@@ -1236,6 +1237,8 @@ uint64_t *data_binary = (uint64_t *)0; // data binary
 uint64_t data_start = 0;               // start of data segment in virtual memory
 uint64_t data_size = 0;                // size of data binary in bytes
 
+uint64_t binary_frames = 0; // code and data binaries are page-aligned frames in target format
+
 uint64_t *code_line_number = (uint64_t *)0; // code line number per emitted instruction
 uint64_t *data_line_number = (uint64_t *)0; // data line number per emitted data word
 
@@ -1251,6 +1254,8 @@ void reset_binary()
   data_start = 0;
   data_size = 0;
 
+  binary_frames = 0;
+
   code_line_number = (uint64_t *)0;
   data_line_number = (uint64_t *)0;
 }
@@ -1287,6 +1292,8 @@ void implement_exit(uint64_t *context);
 
 void emit_read();
 uint64_t copy_buffer(uint64_t *context, uint64_t vbuffer, uint64_t *buffer, uint64_t size, uint64_t upload);
+uint64_t is_page_run_valid(uint64_t *context, uint64_t vaddr, uint64_t run);
+uint64_t copy_page_run(uint64_t *context, uint64_t vaddr, uint64_t run, uint64_t vbuffer, uint64_t *buffer, uint64_t upload, uint64_t is_string);
 void implement_read(uint64_t *context);
 
 void emit_write();
@@ -1317,6 +1324,12 @@ void implement_lock_init(uint64_t *context); // Locks
 void implement_lock_acquire(uint64_t *context);
 void implement_lock_release(uint64_t *context);
 
+void emit_nice(); // CFS
+void implement_nice(uint64_t *context);
+
+void emit_tickets(); // stride
+void implement_tickets(uint64_t *context);
+
 void emit_open();
 uint64_t down_load_string(uint64_t *context, uint64_t vstring, char *s);
 void implement_openat(uint64_t *context);
@@ -1352,6 +1365,10 @@ uint64_t SYSCALL_LOCK_INIT = 218;    // Locks
 uint64_t SYSCALL_LOCK_ACQUIRE = 219;
 uint64_t SYSCALL_LOCK_RELEASE = 220;
 
+uint64_t SYSCALL_NICE = 221; // CFS
+
+uint64_t SYSCALL_TICKETS = 222; // stride
+
 /* DIRFD_AT_FDCWD corresponds to AT_FDCWD in fcntl.h and
    is passed as first argument of the openat system call
    emulating the (in Linux) deprecated open system call. */
@@ -1540,22 +1557,46 @@ uint64_t load_physical_memory(uint64_t *paddr);
 void store_physical_memory(uint64_t *paddr, uint64_t data);
 
 uint64_t get_root_PDE_offset(uint64_t page);
+uint64_t get_mid_PDE_offset(uint64_t page);
 uint64_t get_leaf_PTE_offset(uint64_t page);
 
+uint64_t get_number_of_root_PDEs();
+
+uint64_t load_page_table_entry(uint64_t *parent_table, uint64_t *entry);
+
+uint64_t get_PDE_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page);
 uint64_t *get_PTE_address_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page);
+uint64_t load_PTE_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page);
+uint64_t get_PTE_for_page(uint64_t *table, uint64_t page);
 uint64_t get_frame_for_page(uint64_t *table, uint64_t page);
 
+uint64_t *get_leaf_pt_for_page(uint64_t *table, uint64_t page);
 void set_PTE_for_page(uint64_t *table, uint64_t page, uint64_t frame);
+void set_PDE_for_superpage(uint64_t *table, uint64_t page, uint64_t superframe);
 
 uint64_t is_page_mapped(uint64_t *table, uint64_t page);
+uint64_t is_page_writable(uint64_t *table, uint64_t page);
+uint64_t is_page_swapped(uint64_t *table, uint64_t page);
+
+uint64_t has_PTE_flag(uint64_t PTE, uint64_t flag);
+uint64_t get_PTE_usage_bits(uint64_t PTE);
+void set_PTE_flag(uint64_t *table, uint64_t page, uint64_t flag);
+void clear_PTE_flag(uint64_t *table, uint64_t page, uint64_t flag);
+void set_PTE_usage_bit(uint64_t *table, uint64_t page, uint64_t flag);
 
 uint64_t get_page_of_virtual_address(uint64_t vaddr);
 uint64_t get_virtual_address_of_page_start(uint64_t page);
 
 uint64_t is_virtual_address_valid(uint64_t vaddr, uint64_t alignment);
 uint64_t is_virtual_address_mapped(uint64_t *table, uint64_t vaddr);
+uint64_t is_virtual_address_writable(uint64_t *table, uint64_t vaddr);
+
+void init_tlb();
+void flush_tlb();
+void invalidate_tlb_page(uint64_t *table, uint64_t page);
 
 uint64_t *tlb(uint64_t *table, uint64_t vaddr);
+uint64_t *tlb_for_store(uint64_t *table, uint64_t vaddr);
 
 uint64_t load_virtual_memory(uint64_t *table, uint64_t vaddr);
 void store_virtual_memory(uint64_t *table, uint64_t vaddr, uint64_t data);
@@ -1565,6 +1606,13 @@ void store_cached_virtual_memory(uint64_t *table, uint64_t vaddr, uint64_t data)
 
 uint64_t load_cached_instruction_word(uint64_t *table, uint64_t vaddr);
 
+uint64_t *find_shared_frame(uint64_t frame);
+uint64_t get_frame_references(uint64_t frame);
+void reference_frame(uint64_t frame);
+void unreference_frame(uint64_t frame);
+void pin_frame(uint64_t frame);
+uint64_t is_frame_pinned(uint64_t frame);
+
 // ------------------------ GLOBAL CONSTANTS -----------------------
 
 uint64_t debug_tlb = 0;
@@ -1577,9 +1625,23 @@ uint64_t VIRTUALMEMORYSIZE = 4; // 4GB of virtual memory (avoiding 32-bit overfl
 
 uint64_t PAGESIZE = 4096; // 4KB virtual pages
 
+// target-dependent, see init_target()
 uint64_t NUMBEROFPAGES = 1048576; // VIRTUALMEMORYSIZE * GIGABYTE / PAGESIZE
 
-uint64_t PAGETABLETREE = 1; // two-level page table is default
+// 0: flat page table, 1: two-level page table (default), 2: three-level page table
+uint64_t PAGETABLETREE = 1;
+
+uint64_t SUPERPAGES = 0; // map heap regions to superpages in three-level page tables
+
+// page-aligned frames leave room for flags in page table entries
+uint64_t PTE_READONLY = 1;  // frame is shared copy-on-write
+uint64_t PTE_SUPERPAGE = 2; // PDE refers to superpage frame rather than leaf page table
+uint64_t PTE_ACCESSED = 4;  // page was accessed since bit was cleared
+uint64_t PTE_DIRTY = 8;     // page was stored into since it was mapped or swapped in
+uint64_t PTE_TRACKED = 16;  // page is tracked for replacement
+uint64_t PTE_SWAPPED = 32;  // page is swapped out, entry holds swap slot instead of frame
+
+uint64_t USAGEBITS = 1; // maintain accessed and dirty bits in page table entries
 
 uint64_t PHYSICALMEMORYSIZE = 0;   // total amount of physical memory available for frames
 uint64_t PHYSICALMEMORYEXCESS = 2; // tolerate more allocation than physically available
@@ -1590,6 +1652,87 @@ uint64_t HIGHESTVIRTUALADDRESS = 4294967288; // VIRTUALMEMORYSIZE * GIGABYTE - W
 // host-dependent, see init_memory()
 uint64_t NUMBEROFLEAFPTES = 512; // number of leaf page table entries == PAGESIZE / sizeof(uint64_t*)
 
+// host-dependent, see init_memory()
+uint64_t SUPERPAGESIZE = 2097152; // 2MB superpages == NUMBEROFLEAFPTES * PAGESIZE
+
+// software TLB entry
+// +---+-------+
+// | 0 | table | page table of cached translation (0 if invalid)
+// | 1 | page  | virtual page
+// | 2 | frame | frame of virtual page
+// | 3 | dirty | dirty bit of virtual page is set in page table
+// +---+-------+
+
+uint64_t TLBENTRYSIZE = 4;
+
+uint64_t TLBENTRIES = 256; // number of entries of direct-mapped software TLB
+
+// shared frame
+// +---+------------+
+// | 0 | next       | pointer to next shared frame in bucket
+// | 1 | frame      | frame shared copy-on-write
+// | 2 | references | number of page table entries referring to frame
+// | 3 | pinned     | frame is also referenced by content table or loaded binary
+// +---+------------+
+
+uint64_t SHAREDFRAMEENTRIES = 4;
+
+uint64_t *get_next_shared_frame(uint64_t *entry) { return (uint64_t *)*entry; }
+uint64_t get_shared_frame(uint64_t *entry) { return *(entry + 1); }
+uint64_t get_shared_frame_references(uint64_t *entry) { return *(entry + 2); }
+uint64_t get_shared_frame_pinned(uint64_t *entry) { return *(entry + 3); }
+
+void set_next_shared_frame(uint64_t *entry, uint64_t *next) { *entry = (uint64_t)next; }
+void set_shared_frame(uint64_t *entry, uint64_t frame) { *(entry + 1) = frame; }
+void set_shared_frame_references(uint64_t *entry, uint64_t references) { *(entry + 2) = references; }
+void set_shared_frame_pinned(uint64_t *entry, uint64_t pinned) { *(entry + 3) = pinned; }
+
+uint64_t SHAREDFRAMEBUCKETS = 1024;
+
+// content frame
+// +---+-------+
+// | 0 | next  | pointer to next content frame in bucket
+// | 1 | hash  | hash of page content
+// | 2 | frame | read-only frame holding page content
+// +---+-------+
+
+uint64_t CONTENTFRAMEENTRIES = 3;
+
+uint64_t *get_next_content_frame(uint64_t *entry) { return (uint64_t *)*entry; }
+uint64_t get_content_hash(uint64_t *entry) { return *(entry + 1); }
+uint64_t get_content_frame(uint64_t *entry) { return *(entry + 2); }
+
+void set_next_content_frame(uint64_t *entry, uint64_t *next) { *entry = (uint64_t)next; }
+void set_content_hash(uint64_t *entry, uint64_t hash) { *(entry + 1) = hash; }
+void set_content_frame(uint64_t *entry, uint64_t frame) { *(entry + 2) = frame; }
+
+uint64_t CONTENTFRAMEBUCKETS = 1024;
+
+// ------------------------ GLOBAL VARIABLES -----------------------
+
+uint64_t *TLB = (uint64_t *)0; // software TLB in front of page table walks
+
+uint64_t tlb_hits = 0;
+uint64_t tlb_misses = 0;
+
+// hash table of frames referred to by more than one page table entry,
+// all other mapped frames are referred to exactly once
+uint64_t *shared_frames = (uint64_t *)0;
+uint64_t *free_shared_frames = (uint64_t *)0; // recycled shared frame entries
+
+uint64_t copied_frames = 0; // number of frames copied on write
+
+// hash table of frames with code and data of loaded binaries, each frame
+// is kept referenced by the table and shared copy-on-write by all contexts
+uint64_t *content_frames = (uint64_t *)0;
+
+uint64_t uploaded_pages = 0; // number of code and data pages uploaded into contexts
+uint64_t content_pages = 0;  // number of distinct code and data pages in frames
+
+uint64_t *free_content_frames = (uint64_t *)0; // recycled content frame entries
+
+uint64_t binary_pages = 0; // number of code and data pages mapped from binary without copying
+
 // ------------------------- INITIALIZATION ------------------------
 
 void init_memory(uint64_t megabytes)
@@ -1604,6 +1747,21 @@ void init_memory(uint64_t megabytes)
 
   // host-dependent: reinitialize in case sizeof(uint64_t*) is not 8
   NUMBEROFLEAFPTES = PAGESIZE / sizeof(uint64_t *);
+
+  SUPERPAGESIZE = NUMBEROFLEAFPTES * PAGESIZE;
+
+  init_tlb();
+
+  shared_frames = zmalloc(SHAREDFRAMEBUCKETS * sizeof(uint64_t *));
+
+  copied_frames = 0;
+
+  content_frames = zmalloc(CONTENTFRAMEBUCKETS * sizeof(uint64_t *));
+
+  uploaded_pages = 0;
+  content_pages = 0;
+
+  binary_pages = 0;
 }
 
 // -----------------------------------------------------------------
@@ -1982,13 +2140,100 @@ void fetch();
 void decode();
 void execute();
 
+void fetch_and_decode_cached();
+
+void shrink_register(uint64_t reg);
+uint64_t do_lean_load();
+uint64_t do_lean_store();
+void execute_lean();
+
+uint64_t do_cached_load();
+uint64_t do_cached_store();
+void execute_cached();
+
 void execute_record();
 void execute_undo();
 void execute_debug();
 
+void charge_timer(uint64_t instructions);
 void interrupt();
 
 void run_until_exception();
+void run_lean_until_exception();
+void run_instrumented_until_exception();
+
+uint64_t walk_basic_block(uint64_t *context, uint64_t index, uint64_t trace, uint64_t *block);
+uint64_t *translate_basic_block(uint64_t *context, uint64_t index, uint64_t trace);
+uint64_t *find_basic_block();
+uint64_t *next_basic_block(uint64_t *block);
+void compile_hot_block(uint64_t *block);
+void fuse_basic_block(uint64_t *block);
+void load_block_instruction(uint64_t *instruction);
+uint64_t execute_superinstruction(uint64_t *instruction);
+uint64_t execute_lean_superinstruction(uint64_t *instruction);
+void execute_basic_block(uint64_t *block);
+void execute_lean_basic_block(uint64_t *block);
+
+void run_basic_blocks_until_exception();
+
+// basic block
+// +---+--------------+
+// | 0 | start        | virtual address of first instruction
+// | 1 | length       | number of instructions
+// | 2 | end          | virtual address following block if control falls through
+// | 3 | taken        | chained successor if control leaves block
+// | 4 | fall through | chained successor at end of block
+// | 5 | executions   | number of executions of block
+// | 6 | trace        | hot trace starting with block (block itself if it is a trace)
+// | 7 | next         | previously translated block (for n-gram profiling)
+// +---+--------------+
+// | 8 | instructions | is, rd, rs1, rs2, imm, ir, fusion of each instruction
+// +---+--------------+
+
+uint64_t BASICBLOCKENTRIES = 8;
+uint64_t BLOCKINSTRUCTIONENTRIES = 7;
+
+uint64_t get_block_start(uint64_t *block) { return *block; }
+uint64_t get_block_length(uint64_t *block) { return *(block + 1); }
+uint64_t get_block_end(uint64_t *block) { return *(block + 2); }
+uint64_t *get_block_taken(uint64_t *block) { return (uint64_t *)*(block + 3); }
+uint64_t *get_block_fall_through(uint64_t *block) { return (uint64_t *)*(block + 4); }
+uint64_t get_block_executions(uint64_t *block) { return *(block + 5); }
+uint64_t *get_block_trace(uint64_t *block) { return (uint64_t *)*(block + 6); }
+uint64_t *get_block_next(uint64_t *block) { return (uint64_t *)*(block + 7); }
+uint64_t *get_block_instruction(uint64_t *block, uint64_t i) { return block + BASICBLOCKENTRIES + i * BLOCKINSTRUCTIONENTRIES; }
+
+void set_block_start(uint64_t *block, uint64_t start) { *block = start; }
+void set_block_length(uint64_t *block, uint64_t length) { *(block + 1) = length; }
+void set_block_end(uint64_t *block, uint64_t end) { *(block + 2) = end; }
+void set_block_taken(uint64_t *block, uint64_t *taken) { *(block + 3) = (uint64_t)taken; }
+void set_block_fall_through(uint64_t *block, uint64_t *next) { *(block + 4) = (uint64_t)next; }
+void set_block_executions(uint64_t *block, uint64_t executions) { *(block + 5) = executions; }
+void set_block_trace(uint64_t *block, uint64_t *trace) { *(block + 6) = (uint64_t)trace; }
+void set_block_next(uint64_t *block, uint64_t *next) { *(block + 7) = (uint64_t)next; }
+
+uint64_t get_instruction_fusion(uint64_t *instruction) { return *(instruction + 6); }
+void set_instruction_fusion(uint64_t *instruction, uint64_t fusion) { *(instruction + 6) = fusion; }
+
+// number of executions after which a block is compiled into a hot trace
+uint64_t HOTBLOCKTHRESHOLD = 100;
+
+// maximum number of instructions in a hot trace
+uint64_t MAXTRACELENGTH = 64;
+
+// superinstructions fusing common instruction pairs emitted by the compiler
+
+uint64_t FUSEDLOADADDI  = 1; // ld rd,imm(rs1); addi rs1,rs1,imm: pop
+uint64_t FUSEDLUIADDI   = 2; // lui rd,imm; addi rd,rd,imm: constant materialization
+uint64_t FUSEDADDISTORE = 3; // addi rd,rd,imm; sd rs2,imm(rd): push
+
+// number of opcodes for n-gram profiling (instruction IDs are less than 16)
+uint64_t NGRAMOPCODES = 16;
+
+// number of most frequent n-grams reported in profile
+uint64_t NGRAMSREPORTED = 5;
+
+void print_ngram_profile(char *message, uint64_t n);
 
 uint64_t instruction_with_max_counter(uint64_t *counters, uint64_t max);
 uint64_t print_per_instruction_counter(uint64_t total, uint64_t *counters, uint64_t max);
@@ -2039,6 +2284,10 @@ uint64_t redo = 0;   // flag for redoing code execution
 
 uint64_t disassemble_verbose = 0; // flag for disassembling code in more detail
 
+uint64_t basic_blocks = 0; // flag for executing code in translated basic blocks
+
+uint64_t lean = 0; // flag for executing code without profiling
+
 uint64_t symbolic = 0; // flag for symbolically executing code
 uint64_t model = 0;    // flag for modeling code
 
@@ -2053,12 +2302,49 @@ uint64_t TIMEROFF = 0; // must be 0 to turn off timer interrupt
 uint64_t SCHEDULER_ROUND_ROBIN = 0;
 uint64_t SCHEDULER_RANDOM = 1;
 uint64_t SCHEDULER_CFS = 2;
+uint64_t SCHEDULER_MLFQ = 3;
+uint64_t SCHEDULER_STRIDE = 4;
 
 uint64_t scheduler_type = 0; // default: round-robin (SCHEDULER_ROUND_ROBIN)
 uint64_t random_seed = 12345; // seed for random number generator
 
 uint64_t debug_scheduler = 0; // flag for debugging scheduler decisions
 
+// CFS shares a scheduling period among runnable contexts by weight, the period
+// is the target latency unless more contexts would get less than the minimum
+// granularity each, both in number of instructions
+uint64_t SCHEDLATENCY   = 400000;
+uint64_t MINGRANULARITY = 50000;
+
+// CFS weight of nice level 0, each nice level is worth about 25% of CPU
+uint64_t NICE0WEIGHT = 1024;
+
+uint64_t MINNICE = -20;
+uint64_t MAXNICE = 19;
+
+// MLFQ demotes contexts that used up the allotment of their level,
+// in number of instructions, which doubles with each lower level,
+// and periodically boosts all contexts back to the highest level
+uint64_t MLFQLEVELS    = 4;
+uint64_t MLFQALLOTMENT = 25000;
+uint64_t MLFQBOOST     = 1000000;
+
+// stride scheduling advances the pass of a context by its stride, which is
+// STRIDE1 divided by its tickets, for each executed instruction
+uint64_t STRIDE1 = 1048576; // 2^20
+uint64_t DEFAULTTICKETS = 100;
+
+// number of instructions after which mipster stops, 0 is unlimited
+uint64_t INSTRUCTIONBUDGET = 0;
+
+// number of adjacent pages mapped ahead on a page fault within the same
+// segment, heap pages up to the program break and stack pages below, 0 is off
+uint64_t FAULTAROUND = 0;
+
+// number of timer interrupts between scans for identical pages to be
+// merged into shared frames, 0 is off
+uint64_t KSMINTERVAL = 0;
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 // hardware thread state
@@ -2072,9 +2358,13 @@ uint64_t *registers = (uint64_t *)0; // general-purpose registers
 
 uint64_t *pt = (uint64_t *)0; // page table
 
+uint64_t *decoded_code = (uint64_t *)0; // pre-decoded instructions of current context
+
 // core state
 
 uint64_t timer = 0; // counter for timer interrupt
+
+uint64_t charged_instructions = 0; // number of instructions charged to timer, timer on or off
 uint64_t trap = 0;  // flag for creating a trap
 
 // effective nop counters
@@ -2118,6 +2408,19 @@ uint64_t argument_register_writes = 0;
 uint64_t temporary_register_reads = 0;
 uint64_t temporary_register_writes = 0;
 
+// basic blocks profile
+
+uint64_t translated_blocks = 0; // number of translated basic blocks
+uint64_t hot_traces = 0;        // number of hot blocks compiled into traces
+uint64_t executed_blocks = 0;   // number of executed basic blocks
+uint64_t chained_blocks = 0;    // number of basic blocks reached through chaining
+
+uint64_t fused_pops = 0;      // number of executed ld+addi superinstructions
+uint64_t fused_constants = 0; // number of executed lui+addi superinstructions
+uint64_t fused_pushes = 0;    // number of executed addi+sd superinstructions
+
+uint64_t *translated_block_list = (uint64_t *)0; // list of all translated blocks
+
 // segments profile
 
 uint64_t data_reads = 0;
@@ -2157,6 +2460,8 @@ void reset_interpreter()
 
   pt = (uint64_t *)0;
 
+  decoded_code = (uint64_t *)0;
+
   trap = 0;
 
   timer = TIMEROFF;
@@ -2193,6 +2498,8 @@ void reset_source_profile()
 
 void reset_registers_profile()
 {
+  uint64_t i;
+
   reads_per_register = zmalloc(NUMBEROFREGISTERS * sizeof(uint64_t));
   writes_per_register = zmalloc(NUMBEROFREGISTERS * sizeof(uint64_t));
 
@@ -2206,6 +2513,19 @@ void reset_registers_profile()
   // a6 register is written to by the kernel
   *(writes_per_register + REG_A6) = 1;
 
+  if (lean)
+  {
+    // lean interpreter does not track register initialization
+    i = 0;
+
+    while (i < NUMBEROFREGISTERS)
+    {
+      *(writes_per_register + i) = 1;
+
+      i = i + 1;
+    }
+  }
+
   stack_register_reads = 0;
   stack_register_writes = 0;
   argument_register_reads = 0;
@@ -2251,6 +2571,11 @@ void init_context(uint64_t *context, uint64_t *parent, uint64_t *vctxt);
 uint64_t *find_context(uint64_t *parent, uint64_t *vctxt);
 uint64_t *find_context_by_id(uint64_t id); // Semaphores
 
+uint64_t *get_vctxt_bucket(uint64_t *vctxt);
+uint64_t *get_id_bucket(uint64_t id);
+void index_context(uint64_t *context);
+void unindex_context(uint64_t *context);
+
 void free_context(uint64_t *context);
 uint64_t *delete_context(uint64_t *context, uint64_t *from);
 
@@ -2298,11 +2623,52 @@ uint64_t *delete_context(uint64_t *context, uint64_t *from);
 // | 35 | held_locks_head | pointer to first held lock (Lockdep)
 // | 36 | held_locks_count| number of locks held (Lockdep)
 // +----+-----------------+
+// | 37 | decoded code    | pointer to pre-decoded instructions of code segment
+// | 38 | basic blocks    | pointer to translated basic blocks of code segment
+// +----+-----------------+
+// | 39 | PTE log         | pointer to pages with page table updates since last restore
+// | 40 | PTE log length  | number of logged pages (PTELOGSIZE + 1 if log overflowed)
+// +----+-----------------+
+// | 41 | next by vctxt   | pointer to next context in virtual context hash bucket
+// | 42 | next by id      | pointer to next context in PID hash bucket
+// +----+-----------------+
+// | 43 | vruntime        | virtual runtime for CFS
+// | 44 | run queue left  | pointer to left child in run queue
+// | 45 | run queue right | pointer to right child in run queue
+// | 46 | run queue up    | pointer to parent in run queue
+// | 47 | run queue color | RED or BLACK in run queue, 0 if not queued
+// +----+-----------------+
+// | 48 | nice            | nice level for CFS from -20 to 19
+// | 49 | weight          | CFS weight of nice level
+// | 50 | runtime         | number of instructions executed since last charged to vruntime or level
+// +----+-----------------+
+// | 51 | level           | MLFQ level, 0 is highest priority
+// | 52 | level boosts    | number of MLFQ boosts when level was set
+// | 53 | next in level   | pointer to next context in MLFQ level queue
+// | 54 | prev in level   | pointer to previous context in MLFQ level queue
+// +----+-----------------+
+// | 55 | arrival         | charged instructions when context was created
+// | 56 | I/O ready       | charged instructions when context became ready after I/O (UINT64_MAX if dispatched since)
+// | 57 | completion      | charged instructions when context exited (UINT64_MAX if not yet)
+// +----+-----------------+
+// | 58 | tickets         | number of tickets for stride scheduling
+// | 59 | pass            | pass value for stride scheduling
+// | 60 | CPU time        | number of instructions executed in total
+// +----+-----------------+
+// | 61 | next in state   | pointer to next context in blocked or zombie queue
+// | 62 | prev in state   | pointer to previous context in blocked or zombie queue
+// | 63 | wait kind       | WAIT_SEMAPHORE or WAIT_LOCK if blocked, 0 otherwise
+// | 64 | wait id         | id of semaphore or lock the context waits on
+// | 65 | wait address    | virtual address of semaphore or lock the context waits on
+// +----+-----------------+
+// | 66 | I/O response    | charged instructions from becoming ready after I/O to dispatch in total
+// | 67 | I/O responses   | number of dispatches after I/O
+// +----+-----------------+
 
 // number of entries of a machine context:
-// 14 uint64_t + 6 uint64_t* + 1 char* + 7 uint64_t + 2 uint64_t* + 4 uint64_t entries
+// 14 uint64_t + 6 uint64_t* + 1 char* + 7 uint64_t + 2 uint64_t* + 4 uint64_t + 2 uint64_t* + 1 uint64_t* + 1 uint64_t + 2 uint64_t* + 1 uint64_t + 3 uint64_t* + 6 uint64_t + 2 uint64_t* + 6 uint64_t + 2 uint64_t* + 5 uint64_t entries
 // extended in the symbolic execution engine, the Boehm garbage collector, and Lockdep
-uint64_t CONTEXTENTRIES = 37;
+uint64_t CONTEXTENTRIES = 68;
 
 uint64_t *allocate_context(); // declaration avoids warning in the Boehm garbage collector
 
@@ -2349,6 +2715,8 @@ uint64_t use_gc_kernel(uint64_t *context) { return (uint64_t)(context + 31); }
 uint64_t id_context(uint64_t* context) { return (uint64_t)(context + 32); } // fork
 uint64_t ptr_parent_ctx(uint64_t* context) { return (uint64_t)(context + 33); } // fork
 uint64_t blocked(uint64_t* context) { return (uint64_t)(context + 34); } // semaphores
+uint64_t PTE_log(uint64_t *context) { return (uint64_t)(context + 39); }
+uint64_t PTE_log_length(uint64_t *context) { return (uint64_t)(context + 40); }
 
 uint64_t *get_next_context(uint64_t *context) { return (uint64_t *)*context; }
 uint64_t *get_prev_context(uint64_t *context) { return (uint64_t *)*(context + 1); }
@@ -2387,7 +2755,37 @@ uint64_t get_use_gc_kernel(uint64_t *context) { return *(context + 31); }
 uint64_t get_id_context(uint64_t *context) { return *(context + 32); } // fork
 uint64_t* get_ptr_parent_ctx(uint64_t *context) { return (uint64_t*)*(context + 33); } // fork
 uint64_t get_blocked(uint64_t *context) { return *(context + 34); } // semaphores
-uint64_t get_vruntime(uint64_t *context) { return *(context + 35); } // CFS scheduler
+uint64_t *get_decoded_code(uint64_t *context) { return (uint64_t *)*(context + 37); }
+uint64_t *get_basic_blocks(uint64_t *context) { return (uint64_t *)*(context + 38); }
+uint64_t *get_PTE_log(uint64_t *context) { return (uint64_t *)*(context + 39); }
+uint64_t get_PTE_log_length(uint64_t *context) { return *(context + 40); }
+uint64_t *get_next_by_vctxt(uint64_t *context) { return (uint64_t *)*(context + 41); }
+uint64_t *get_next_by_id(uint64_t *context) { return (uint64_t *)*(context + 42); }
+uint64_t get_vruntime(uint64_t *context) { return *(context + 43); } // CFS scheduler
+uint64_t *get_rq_left(uint64_t *context) { return (uint64_t *)*(context + 44); }
+uint64_t *get_rq_right(uint64_t *context) { return (uint64_t *)*(context + 45); }
+uint64_t *get_rq_up(uint64_t *context) { return (uint64_t *)*(context + 46); }
+uint64_t get_rq_color(uint64_t *context) { return *(context + 47); }
+uint64_t get_nice(uint64_t *context) { return *(context + 48); }
+uint64_t get_weight(uint64_t *context) { return *(context + 49); }
+uint64_t get_runtime(uint64_t *context) { return *(context + 50); }
+uint64_t get_level(uint64_t *context) { return *(context + 51); }
+uint64_t get_level_boosts(uint64_t *context) { return *(context + 52); }
+uint64_t *get_next_in_level(uint64_t *context) { return (uint64_t *)*(context + 53); }
+uint64_t *get_prev_in_level(uint64_t *context) { return (uint64_t *)*(context + 54); }
+uint64_t get_arrival(uint64_t *context) { return *(context + 55); }
+uint64_t get_io_ready(uint64_t *context) { return *(context + 56); }
+uint64_t get_completion(uint64_t *context) { return *(context + 57); }
+uint64_t get_tickets(uint64_t *context) { return *(context + 58); }
+uint64_t get_pass(uint64_t *context) { return *(context + 59); }
+uint64_t get_cpu_time(uint64_t *context) { return *(context + 60); }
+uint64_t *get_next_in_state(uint64_t *context) { return (uint64_t *)*(context + 61); }
+uint64_t *get_prev_in_state(uint64_t *context) { return (uint64_t *)*(context + 62); }
+uint64_t get_wait_kind(uint64_t *context) { return *(context + 63); }
+uint64_t get_wait_id(uint64_t *context) { return *(context + 64); }
+uint64_t get_wait_address(uint64_t *context) { return *(context + 65); }
+uint64_t get_io_response(uint64_t *context) { return *(context + 66); }
+uint64_t get_io_responses(uint64_t *context) { return *(context + 67); }
 
 void set_next_context(uint64_t *context, uint64_t *next) { *context = (uint64_t)next; }
 void set_prev_context(uint64_t *context, uint64_t *prev) { *(context + 1) = (uint64_t)prev; }
@@ -2426,7 +2824,56 @@ void set_use_gc_kernel(uint64_t *context, uint64_t use) { *(context + 31) = use;
 void set_id_context(uint64_t *context, uint64_t pid) { *(context + 32) = pid; } // fork
 void set_ptr_parent_ctx(uint64_t *context, uint64_t* pctx) { *(context + 33) = (uint64_t)pctx; } // fork
 void set_blocked(uint64_t *context, uint64_t block) { *(context + 34) = block; } // semaphores
-void set_vruntime(uint64_t *context, uint64_t vruntime) { *(context + 35) = vruntime; } // CFS scheduler
+void set_decoded_code(uint64_t *context, uint64_t *code) { *(context + 37) = (uint64_t)code; }
+void set_basic_blocks(uint64_t *context, uint64_t *blocks) { *(context + 38) = (uint64_t)blocks; }
+void set_PTE_log(uint64_t *context, uint64_t *log) { *(context + 39) = (uint64_t)log; }
+void set_PTE_log_length(uint64_t *context, uint64_t length) { *(context + 40) = length; }
+void set_next_by_vctxt(uint64_t *context, uint64_t *next) { *(context + 41) = (uint64_t)next; }
+void set_next_by_id(uint64_t *context, uint64_t *next) { *(context + 42) = (uint64_t)next; }
+void set_vruntime(uint64_t *context, uint64_t vruntime) { *(context + 43) = vruntime; } // CFS scheduler
+void set_rq_left(uint64_t *context, uint64_t *left) { *(context + 44) = (uint64_t)left; }
+void set_rq_right(uint64_t *context, uint64_t *right) { *(context + 45) = (uint64_t)right; }
+void set_rq_up(uint64_t *context, uint64_t *up) { *(context + 46) = (uint64_t)up; }
+void set_rq_color(uint64_t *context, uint64_t color) { *(context + 47) = color; }
+void set_nice(uint64_t *context, uint64_t nice) { *(context + 48) = nice; }
+void set_weight(uint64_t *context, uint64_t weight) { *(context + 49) = weight; }
+void set_runtime(uint64_t *context, uint64_t runtime) { *(context + 50) = runtime; }
+void set_level(uint64_t *context, uint64_t level) { *(context + 51) = level; }
+void set_level_boosts(uint64_t *context, uint64_t boosts) { *(context + 52) = boosts; }
+void set_next_in_level(uint64_t *context, uint64_t *next) { *(context + 53) = (uint64_t)next; }
+void set_prev_in_level(uint64_t *context, uint64_t *prev) { *(context + 54) = (uint64_t)prev; }
+void set_arrival(uint64_t *context, uint64_t arrival) { *(context + 55) = arrival; }
+void set_io_ready(uint64_t *context, uint64_t ready) { *(context + 56) = ready; }
+void set_completion(uint64_t *context, uint64_t completion) { *(context + 57) = completion; }
+void set_tickets(uint64_t *context, uint64_t tickets) { *(context + 58) = tickets; }
+void set_pass(uint64_t *context, uint64_t pass) { *(context + 59) = pass; }
+void set_cpu_time(uint64_t *context, uint64_t time) { *(context + 60) = time; }
+void set_next_in_state(uint64_t *context, uint64_t *next) { *(context + 61) = (uint64_t)next; }
+void set_prev_in_state(uint64_t *context, uint64_t *prev) { *(context + 62) = (uint64_t)prev; }
+void set_wait_kind(uint64_t *context, uint64_t kind) { *(context + 63) = kind; }
+void set_wait_id(uint64_t *context, uint64_t id) { *(context + 64) = id; }
+void set_wait_address(uint64_t *context, uint64_t address) { *(context + 65) = address; }
+void set_io_response(uint64_t *context, uint64_t response) { *(context + 66) = response; }
+void set_io_responses(uint64_t *context, uint64_t responses) { *(context + 67) = responses; }
+
+// decoded instruction
+// +---+-----------+
+// | 0 | ir        | instruction register
+// | 1 | ids       | is + rd * 16 + rs1 * 16 * 32 + rs2 * 16 * 32 * 32 (0 if not yet decoded)
+// | 2 | imm       | immediate value
+// +---+-----------+
+
+uint64_t DECODEDENTRIES = 3;
+
+uint64_t *get_decoded_instruction(uint64_t *code, uint64_t index) { return code + index * DECODEDENTRIES; }
+
+uint64_t get_decoded_ir(uint64_t *entry) { return *entry; }
+uint64_t get_decoded_ids(uint64_t *entry) { return *(entry + 1); }
+uint64_t get_decoded_imm(uint64_t *entry) { return *(entry + 2); }
+
+void set_decoded_ir(uint64_t *entry, uint64_t ir) { *entry = ir; }
+void set_decoded_ids(uint64_t *entry, uint64_t ids) { *(entry + 1) = ids; }
+void set_decoded_imm(uint64_t *entry, uint64_t imm) { *(entry + 2) = imm; }
 
 // semaphore_struct
 // +---+--------------------+
@@ -3030,8 +3477,10 @@ uint64_t create_lock(); // Locks
 
 uint64_t lowest_page(uint64_t page, uint64_t lo);
 uint64_t highest_page(uint64_t page, uint64_t hi);
+void log_page_update(uint64_t *context, uint64_t page);
 void map_page(uint64_t *context, uint64_t page, uint64_t frame);
 
+void restore_page(uint64_t *context, uint64_t *table, uint64_t *parent_table, uint64_t page);
 void restore_region(uint64_t *context, uint64_t *table, uint64_t *parent_table, uint64_t lo, uint64_t hi);
 void restore_context(uint64_t *context);
 
@@ -3042,6 +3491,7 @@ uint64_t is_heap_address(uint64_t *context, uint64_t vaddr);
 
 uint64_t is_address_between_stack_and_heap(uint64_t *context, uint64_t vaddr);
 uint64_t is_data_stack_heap_address(uint64_t *context, uint64_t vaddr);
+uint64_t is_data_stack_heap_region(uint64_t *context, uint64_t vaddr, uint64_t last);
 
 uint64_t is_valid_segment_read(uint64_t vaddr);
 uint64_t is_valid_segment_write(uint64_t vaddr);
@@ -3051,6 +3501,10 @@ uint64_t is_valid_segment_write(uint64_t vaddr);
 uint64_t debug_create = 0;
 uint64_t debug_map = 0;
 
+// number of page table updates logged per context between restores,
+// more updates fall back to rescanning the page table cache regions
+uint64_t PTELOGSIZE = 64;
+
 // ------------------------ GLOBAL VARIABLES -----------------------
 
 uint64_t *current_context = (uint64_t *)0; // context currently running
@@ -3058,6 +3512,46 @@ uint64_t *current_context = (uint64_t *)0; // context currently running
 uint64_t *used_contexts = (uint64_t *)0; // doubly-linked list of used contexts
 uint64_t *free_contexts = (uint64_t *)0; // singly-linked list of free contexts
 
+// hash tables of used contexts by virtual context and by PID,
+// chained through the next by vctxt and next by id entries
+uint64_t CONTEXTBUCKETS = 1024;
+
+uint64_t *contexts_by_vctxt = (uint64_t *)0;
+uint64_t *contexts_by_id    = (uint64_t *)0;
+
+// CFS run queue: red-black tree of runnable contexts ordered by vruntime,
+// linked through the run queue entries of contexts
+uint64_t RQ_RED   = 1;
+uint64_t RQ_BLACK = 2;
+
+uint64_t *run_queue = (uint64_t *)0;
+
+uint64_t queued_contexts = 0; // number of contexts in run queue or MLFQ level queues
+uint64_t queued_weight   = 0; // sum of CFS weights of contexts in run queue
+
+uint64_t min_vruntime = 0; // largest vruntime of any context selected by CFS
+
+// MLFQ level queues of ready contexts, allocated on first use,
+// linked through the next and prev in level entries of contexts
+uint64_t *level_heads = (uint64_t *)0;
+uint64_t *level_tails = (uint64_t *)0;
+
+uint64_t mlfq_boosts = 0; // number of MLFQ boosts so far
+uint64_t last_boost  = 0; // charged instructions at last MLFQ boost
+
+uint64_t global_pass = 0; // largest pass of any context selected by stride scheduling
+
+// blocked and exited (zombie) contexts at my boot level are kept apart from
+// the run queue, linked through the next and prev in state entries of contexts
+uint64_t *blocked_contexts = (uint64_t *)0;
+uint64_t *zombie_contexts  = (uint64_t *)0;
+
+uint64_t WAIT_SEMAPHORE = 1;
+uint64_t WAIT_LOCK      = 2;
+
+uint64_t synced_PTEs = 0;    // number of page table entries of hosted contexts synchronized
+uint64_t rescanned_PTEs = 0; // number of those synchronized by rescanning regions
+
 uint64_t *used_semaphores = (uint64_t *)0; // Semaphores: Array of used semaphores
 uint64_t *used_locks = (uint64_t *)0; // Locks: Array of used locks
 
@@ -3091,6 +3585,53 @@ uint64_t pused();
 uint64_t *palloc();
 void pfree(uint64_t *frame);
 
+uint64_t *palloc_superpage();
+
+void release_frame(uint64_t frame);
+void release_page_table_entries(uint64_t *context, uint64_t *entries, uint64_t number_of_entries);
+void release_page_directory_entry(uint64_t *context, uint64_t *PDE);
+void reclaim_frames(uint64_t *context);
+
+void share_page(uint64_t *context, uint64_t *child, uint64_t page);
+void copy_on_write(uint64_t *context, uint64_t page);
+void make_writable(uint64_t *context, uint64_t vaddr);
+
+void copy_page(uint64_t *to, uint64_t *from);
+
+uint64_t available_page_frames();
+uint64_t *get_swap_slot(uint64_t slot);
+uint64_t allocate_swap_slot();
+void free_swap_slot(uint64_t slot);
+
+void track_page(uint64_t *context, uint64_t page);
+void untrack_page(uint64_t *previous, uint64_t *entry);
+void untrack_pages(uint64_t *context);
+
+uint64_t is_hosting(uint64_t *context);
+uint64_t is_page_evictable(uint64_t *entry);
+void age_resident_pages();
+uint64_t *select_victim_page();
+uint64_t evict_page();
+void reserve_page_frames();
+
+uint64_t swap_in_page(uint64_t *context, uint64_t page);
+void make_resident(uint64_t *context, uint64_t vaddr);
+uint64_t *get_page_content(uint64_t *context, uint64_t page);
+
+void merge_page(uint64_t *context, uint64_t page, uint64_t frame);
+uint64_t merge_candidate(uint64_t *context, uint64_t page, uint64_t hash);
+void scan_page(uint64_t *context, uint64_t page);
+void scan_identical_pages();
+
+uint64_t hash_page_content(uint64_t *content);
+uint64_t is_frame_content(uint64_t frame, uint64_t *content);
+uint64_t find_content_frame(uint64_t *content, uint64_t hash);
+void insert_content_frame(uint64_t frame, uint64_t hash);
+void release_content_frames();
+void release_content_frame(uint64_t frame);
+void map_content_page(uint64_t *context, uint64_t page, uint64_t *content);
+void up_load_segment(uint64_t *context, uint64_t *binary, uint64_t start, uint64_t size, uint64_t *content);
+
 void map_and_store(uint64_t *context, uint64_t vaddr, uint64_t data);
 
 void up_load_binary(uint64_t *context);
@@ -3099,11 +3640,57 @@ uint64_t up_load_string(uint64_t *context, char *s, uint64_t SP);
 void up_load_arguments(uint64_t *context, uint64_t argc, uint64_t *argv);
 
 uint64_t handle_system_call(uint64_t *context);
+uint64_t map_superpage(uint64_t *context, uint64_t page);
 uint64_t handle_page_fault(uint64_t *context);
+void map_page_around_fault(uint64_t *context, uint64_t page);
+void map_pages_around_fault(uint64_t *context, uint64_t page);
 uint64_t handle_division_by_zero(uint64_t *context);
 uint64_t handle_timer(uint64_t *context);
 uint64_t handle_exception(uint64_t *context);
 
+uint64_t is_schedulable(uint64_t *context);
+
+uint64_t get_run_queue_key(uint64_t *context);
+uint64_t is_queued_before(uint64_t *context, uint64_t *other);
+uint64_t is_red_in_run_queue(uint64_t *context);
+uint64_t is_black_below_root(uint64_t *context);
+void replace_in_run_queue(uint64_t *context, uint64_t *by);
+void rotate_run_queue_left(uint64_t *context);
+void rotate_run_queue_right(uint64_t *context);
+void enqueue_context(uint64_t *context);
+void rebalance_run_queue(uint64_t *context, uint64_t *parent);
+void dequeue_context(uint64_t *context);
+void update_vruntime(uint64_t *context, uint64_t vruntime);
+void renice_context(uint64_t *context, uint64_t nice);
+void account_runtime(uint64_t *context, uint64_t instructions);
+void charge_vruntime(uint64_t *context);
+void charge_pass(uint64_t *context);
+uint64_t is_budget_exhausted();
+
+void insert_into_state_queue(uint64_t *context);
+void remove_from_state_queue(uint64_t *context);
+void block_context(uint64_t *context, uint64_t kind, uint64_t id, uint64_t address);
+void retire_context(uint64_t *context);
+void print_wait_for_graph();
+uint64_t stop_scheduling();
+void wake_up_context(uint64_t *context);
+uint64_t context_timeslice(uint64_t *context);
+
+uint64_t level_allotment(uint64_t level);
+uint64_t refresh_level(uint64_t *context);
+uint64_t is_level_queued(uint64_t *context);
+void append_to_level(uint64_t *context);
+void remove_from_level(uint64_t *context);
+void boost_levels();
+void charge_level(uint64_t *context);
+uint64_t *rotate_level(uint64_t level);
+uint64_t *select_mlfq_context();
+uint64_t *first_queued_context();
+uint64_t *next_queued_context(uint64_t *context);
+uint64_t *select_queued_context_after(uint64_t *context);
+
+uint64_t *schedule_context(uint64_t *from_context);
+
 uint64_t mipster(uint64_t *to_context);
 uint64_t hypster(uint64_t *to_context);
 
@@ -3121,6 +3708,10 @@ char *increment_boot_level_prefix(char *s, char *t);
 
 void boot_loader(uint64_t *context);
 
+uint64_t hash_code();
+void save_snapshot(uint64_t *context);
+void restore_snapshot(uint64_t *context);
+
 uint64_t selfie_run(uint64_t machine);
 
 uint64_t selfie_run_mipsterOS(uint64_t machine); // process_lab
@@ -3150,6 +3741,7 @@ uint64_t EXITCODE_UNKNOWNSYSCALL = 24;
 uint64_t EXITCODE_UNSUPPORTEDSYSCALL = 25;
 uint64_t EXITCODE_MULTIPLEEXCEPTIONERROR = 26;
 uint64_t EXITCODE_UNCAUGHTEXCEPTION = 27;
+uint64_t EXITCODE_DEADLOCK = 28;
 
 uint64_t SYSCALL_BITWIDTH = 32; // integer bit width for system calls
 
@@ -3164,6 +3756,79 @@ uint64_t *MACHINES; // named machines
 uint64_t DIPSTER = 5;
 uint64_t RIPSTER = 6;
 uint64_t CAPSTER = 7;
+uint64_t BIPSTER = 8;
+
+// snapshot image
+// +---------------+
+// | header        | PAGESIZE bytes: SNAPSHOTMAGIC, WORDSIZE, pc, segments, pages, code hash, registers
+// | page index    | one word per mapped page, padded to PAGESIZE bytes
+// | frames        | contents of mapped frames in page index order
+// +---------------+
+// frames start page-aligned in the image so that it may be mapped into memory
+
+uint64_t SNAPSHOTMAGIC = 1346457171; // "SNAP" in little endian, fits 32-bit words
+
+uint64_t SNAPSHOTCODEHASH  = 10; // offset of hash of loaded code in snapshot header
+uint64_t SNAPSHOTREGISTERS = 11; // offset of registers in snapshot header
+
+// page replacement policies for swapping
+uint64_t SWAPOFF = 0;
+uint64_t SWAPFIFO = 1;  // evict page resident for the longest time
+uint64_t SWAPCLOCK = 2; // second chance for pages with accessed bit set
+uint64_t SWAPLRU = 3;   // approximate LRU by aging accessed bits on timer interrupts
+
+uint64_t SWAPSIZE = 64; // MB of swap space
+
+// simulated cost of transferring one page between memory and swap space,
+// in executed instructions (~10us at 1 GIPS)
+uint64_t SWAPIOCOST = 10000;
+
+// resident page
+// +---+---------+
+// | 0 | next    | pointer to next resident page in replacement order
+// | 1 | context | context of page
+// | 2 | page    | virtual page
+// | 3 | age     | aging counter approximating LRU
+// | 4 | slot    | swap slot + 1 with clean copy of page, 0 if none
+// +---+---------+
+
+uint64_t RESIDENTPAGEENTRIES = 5;
+
+uint64_t *get_next_resident(uint64_t *entry) { return (uint64_t *)*entry; }
+uint64_t *get_resident_context(uint64_t *entry) { return (uint64_t *)*(entry + 1); }
+uint64_t get_resident_page(uint64_t *entry) { return *(entry + 2); }
+uint64_t get_resident_age(uint64_t *entry) { return *(entry + 3); }
+uint64_t get_resident_slot(uint64_t *entry) { return *(entry + 4); }
+
+void set_next_resident(uint64_t *entry, uint64_t *next) { *entry = (uint64_t)next; }
+void set_resident_context(uint64_t *entry, uint64_t *context) { *(entry + 1) = (uint64_t)context; }
+void set_resident_page(uint64_t *entry, uint64_t page) { *(entry + 2) = page; }
+void set_resident_age(uint64_t *entry, uint64_t age) { *(entry + 3) = age; }
+void set_resident_slot(uint64_t *entry, uint64_t slot) { *(entry + 4) = slot; }
+
+uint64_t AGEMSB = 128; // most significant bit of 8-bit aging counter
+
+// merge candidate
+// +---+---------+
+// | 0 | next    | pointer to next candidate in hash bucket
+// | 1 | hash    | hash of page content
+// | 2 | context | context of page
+// | 3 | page    | virtual page
+// +---+---------+
+
+uint64_t CANDIDATEENTRIES = 4;
+
+uint64_t *get_next_candidate(uint64_t *entry) { return (uint64_t *)*entry; }
+uint64_t get_candidate_hash(uint64_t *entry) { return *(entry + 1); }
+uint64_t *get_candidate_context(uint64_t *entry) { return (uint64_t *)*(entry + 2); }
+uint64_t get_candidate_page(uint64_t *entry) { return *(entry + 3); }
+
+void set_next_candidate(uint64_t *entry, uint64_t *next) { *entry = (uint64_t)next; }
+void set_candidate_hash(uint64_t *entry, uint64_t hash) { *(entry + 1) = hash; }
+void set_candidate_context(uint64_t *entry, uint64_t *context) { *(entry + 2) = (uint64_t)context; }
+void set_candidate_page(uint64_t *entry, uint64_t page) { *(entry + 3) = page; }
+
+uint64_t CANDIDATEBUCKETS = 1024;
 
 // ------------------------ GLOBAL VARIABLES -----------------------
 
@@ -3172,6 +3837,50 @@ uint64_t next_page_frame = 0;
 uint64_t allocated_page_frame_memory = 0;
 uint64_t free_page_frame_memory = 0;
 
+uint64_t *free_frames = (uint64_t *)0; // singly-linked list of reclaimed page frames
+
+uint64_t reclaimed_page_frame_memory = 0; // memory in reclaimed page frames on free list
+uint64_t peak_page_frame_memory = 0;      // maximum of used page frame memory
+
+uint64_t reclaimed_frames = 0; // number of page frames reclaimed in total
+
+uint64_t faultaround_pages = 0; // number of pages mapped ahead of page faults
+
+uint64_t mapped_superpages = 0; // number of superpages mapped on page faults
+
+uint64_t swap_policy = 2; // page replacement policy, clock by default
+
+uint64_t *swap_slots = (uint64_t *)0; // swap space, allocated slot by slot
+uint64_t next_swap_slot = 0;          // number of slots allocated so far
+uint64_t *free_swap_slots = (uint64_t *)0; // singly-linked list of freed swap slots
+
+uint64_t *resident_pages = (uint64_t *)0;      // tracked pages in replacement order
+uint64_t *last_resident_page = (uint64_t *)0;  // tail for FIFO order
+uint64_t *clock_hand = (uint64_t *)0;          // next page examined by clock
+uint64_t *free_resident_pages = (uint64_t *)0; // recycled resident page entries
+
+uint64_t number_of_resident_pages = 0;
+
+uint64_t page_ins = 0;         // number of pages read from swap space
+uint64_t page_outs = 0;        // number of pages written to swap space
+uint64_t clean_evictions = 0;  // number of evictions without writing to swap space
+
+// hash table of pages seen once during a scan for identical pages,
+// emptied after each scan
+uint64_t *merge_candidates = (uint64_t *)0;
+uint64_t *free_candidates = (uint64_t *)0; // recycled merge candidate entries
+
+uint64_t ksm_ticks = 0; // number of timer interrupts since last scan
+
+uint64_t ksm_scans = 0;    // number of scans for identical pages
+uint64_t merged_pages = 0; // number of pages merged into shared frames
+uint64_t saved_frames = 0; // number of frames freed by merging
+
+char *snapshot_name = (char *)0; // file name of snapshot image to be saved
+uint64_t snapshot_timeslices = 0; // number of timeslices before snapshot is saved
+
+char *restore_name = (char *)0; // file name of snapshot image to be restored
+
 // ------------------------- INITIALIZATION ------------------------
 
 void init_kernel()
@@ -3251,9 +3960,6 @@ void init_selfie(uint64_t argc, uint64_t *argv)
   // }
 
   selfie_name = get_argument();
-
-  printf("%s: This is Isaac Vera's Selfie!\n", selfie_name); //LAB_0
-
 }
 
 void init_system()
@@ -3374,7 +4080,14 @@ void init_target()
     e_phentsize = 32; // size of program header entry 32 bytes (ELFCLASS32)
   }
 
+  if (IS64BITTARGET == 0)
+    // 32-bit addresses reach at most 4GB
+    if (VIRTUALMEMORYSIZE > 4)
+      VIRTUALMEMORYSIZE = 4;
+
   HIGHESTVIRTUALADDRESS = VIRTUALMEMORYSIZE * GIGABYTE - WORDSIZE;
+
+  NUMBEROFPAGES = VIRTUALMEMORYSIZE * (GIGABYTE / PAGESIZE);
 }
 
 void turn_on_gc_library(uint64_t period, char *name)
@@ -7533,6 +8246,10 @@ void selfie_compile()
   emit_lock_init(); // locks
   emit_lock_acquire();
   emit_lock_release();
+
+  emit_nice(); // CFS
+
+  emit_tickets(); // stride
   
   emit_malloc();
 
@@ -8549,6 +9266,13 @@ uint64_t *touch(uint64_t *memory, uint64_t bytes)
   return memory;
 }
 
+uint64_t *allocate_page_aligned(uint64_t bytes)
+{
+  // zeroed memory starting at page boundary, for use as page frames,
+  // touched to make sure it is mapped for reading into it
+  return touch((uint64_t *)round_up((uint64_t)zmalloc(bytes + PAGESIZE), PAGESIZE), bytes);
+}
+
 uint64_t *allocate_elf_header()
 {
   // allocate and map (on all boot levels) zeroed memory for ELF header preparing
@@ -8812,9 +9536,10 @@ void selfie_load()
   // this call makes sure ELF_header is mapped for reading into it
   ELF_header = allocate_elf_header();
 
-  // make sure code and data binaries are also mapped for reading into them
-  code_binary = touch(smalloc(MAX_CODE_SIZE), MAX_CODE_SIZE);
-  data_binary = touch(smalloc(MAX_DATA_SIZE), MAX_DATA_SIZE);
+  // code and data binaries are read into page-aligned memory that can be
+  // mapped into contexts as page frames without copying
+  code_binary = allocate_page_aligned(MAX_CODE_SIZE);
+  data_binary = allocate_page_aligned(MAX_DATA_SIZE);
 
   number_of_read_bytes = read(fd, ELF_header, ELF_HEADER_SIZE);
 
@@ -8839,6 +9564,8 @@ void selfie_load()
           // check if we are really at EOF
           if (read(fd, binary_buffer, sizeof(uint64_t)) == 0)
           {
+            // single word on 32-bit target occupies double word in page frames
+            binary_frames = (sizeof(uint64_t) == WORDSIZE);
             printf("%s: %lu bytes with %lu %lu-bit RISC-U instructions and %lu bytes of data loaded from %s\n",
                    selfie_name,
                    ELF_HEADER_SIZE + code_size + data_size,
@@ -8921,10 +9648,75 @@ void emit_read()
   emit_jalr(REG_ZR, REG_RA, 0);
 }
 
+uint64_t is_page_run_valid(uint64_t *context, uint64_t vaddr, uint64_t run)
+{
+  // assert: run > 0 and vaddr + run - 1 is in the page of vaddr
+
+  if (is_virtual_address_valid(vaddr, WORDSIZE))
+    if (is_virtual_address_valid(vaddr + run - WORDSIZE, WORDSIZE))
+      if (is_data_stack_heap_region(context, vaddr, vaddr + run - WORDSIZE))
+        return is_virtual_address_mapped(get_pt(context), vaddr);
+
+  return 0;
+}
+
+uint64_t copy_page_run(uint64_t *context, uint64_t vaddr, uint64_t run, uint64_t vbuffer, uint64_t *buffer, uint64_t upload, uint64_t is_string)
+{
+  uint64_t *paddr;
+  uint64_t offset;
+  uint64_t i;
+
+  // copies run bytes at vaddr within the same page with a single
+  // address translation, returns 1 if a string ends in the run
+
+  // assert: is_page_run_valid(context, vaddr, run) == 1
+
+  if (upload)
+  {
+    make_writable(context, vaddr);
+
+    paddr = tlb_for_store(get_pt(context), vaddr);
+  }
+  else
+    paddr = tlb(get_pt(context), vaddr);
+
+  offset = vaddr - vbuffer;
+
+  while (run > 0)
+  {
+    // single word on 32-bit target occupies double word in physical memory
+    if (upload)
+      store_physical_memory(paddr, load_word(buffer, offset, 1));
+    else
+      store_word(buffer, offset, 1, load_physical_memory(paddr));
+
+    if (is_string)
+    {
+      i = 0;
+
+      // check if string ends in the current word
+      while (i < WORDSIZE)
+      {
+        if (load_character((char *)buffer, offset + i) == 0)
+          return 1;
+
+        i = i + 1;
+      }
+    }
+
+    paddr = paddr + 1;
+    offset = offset + WORDSIZE;
+    run = run - WORDSIZE;
+  }
+
+  return 0;
+}
+
 uint64_t copy_buffer(uint64_t *context, uint64_t vbuffer, uint64_t *buffer, uint64_t size, uint64_t upload)
 {
   uint64_t is_string;
   uint64_t vaddr;
+  uint64_t run;
   uint64_t i;
 
   if (size == 0)
@@ -8942,13 +9734,35 @@ uint64_t copy_buffer(uint64_t *context, uint64_t vbuffer, uint64_t *buffer, uint
   // avoid integer overflow with vbuffer + size
   while (vaddr - vbuffer < size)
   {
+    // bytes in whole words up to the end of the page or the buffer
+    run = PAGESIZE - vaddr % PAGESIZE;
+
+    if (run > round_up(size - (vaddr - vbuffer), WORDSIZE))
+      run = round_up(size - (vaddr - vbuffer), WORDSIZE);
+
     if (is_virtual_address_valid(vaddr, WORDSIZE))
+      make_resident(context, vaddr);
+
+    if (is_page_run_valid(context, vaddr, run))
+    {
+      // translate once and copy all words up to the end of the page or buffer
+      if (copy_page_run(context, vaddr, run, vbuffer, buffer, upload, is_string))
+        return 1;
+
+      vaddr = vaddr + run;
+    }
+    else if (is_virtual_address_valid(vaddr, WORDSIZE))
+      // otherwise check and copy next word individually for precise error messages
       if (is_data_stack_heap_address(context, vaddr))
       {
         if (is_virtual_address_mapped(get_pt(context), vaddr))
         {
           if (upload)
+          {
+            make_writable(context, vaddr);
+
             store_virtual_memory(get_pt(context), vaddr, load_word(buffer, vaddr - vbuffer, 1));
+          }
           else
             store_word(buffer, vaddr - vbuffer, 1, load_virtual_memory(get_pt(context), vaddr));
         }
@@ -9130,6 +9944,9 @@ void implement_write(uint64_t *context)
 
   set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
 
+  // the context is ready again as soon as its output is written
+  set_io_ready(context, charged_instructions);
+
   if (debug_write)
     printf("%s: actually wrote %lu bytes into file with descriptor %lu\n", selfie_name,
            sign_extend(*(get_regs(context) + REG_A0), SYSCALL_BITWIDTH), fd);
@@ -9274,43 +10091,27 @@ void implement_fork(uint64_t *context){ // fork
   set_fault(child_context, get_fault(context));
   set_exit_code(child_context, get_exit_code(context));
 
-  // 2. Copiar segmento de CÓDIGO
-  bgn = get_code_seg_start(context);
-  end = get_code_seg_start(context) + get_code_seg_size(context);
-  while (bgn < end){
-    if (is_virtual_address_mapped(get_pt(context), bgn))
-      map_and_store(child_context, bgn, load_virtual_memory(get_pt(context), bgn));
-    bgn = bgn + WORDSIZE;
+  // code segment is identical, share pre-decoded instructions and basic blocks
+  set_decoded_code(child_context, get_decoded_code(context));
+  set_basic_blocks(child_context, get_basic_blocks(context));
+
+  // 2. Compartir páginas de CÓDIGO, DATOS y HEAP copy-on-write
+  bgn = get_page_of_virtual_address(get_code_seg_start(context));
+  end = get_page_of_virtual_address(get_program_break(context) - WORDSIZE);
+  while (bgn <= end){
+    share_page(context, child_context, bgn);
+    bgn = bgn + 1;
   }
-  
-  // 3. Copiar segmento de DATOS
-  bgn = get_data_seg_start(context);
-  end = get_data_seg_start(context) + get_data_seg_size(context);
-  while (bgn < end){
-    if (is_virtual_address_mapped(get_pt(context), bgn))
-      map_and_store(child_context, bgn, load_virtual_memory(get_pt(context), bgn));
-    bgn = bgn + WORDSIZE;
-  }
-
-  // 4. Copiar segmento de HEAP
-  bgn = get_heap_seg_start(context);
-  end = get_program_break(context);
-  while (bgn < end){
-    if (is_virtual_address_mapped(get_pt(context), bgn))
-      map_and_store(child_context, bgn, load_virtual_memory(get_pt(context), bgn));
-    bgn = bgn + WORDSIZE;
-  }
-
-  // 5. Copiar segmento de STACK
-  bgn = *(get_regs(context) + REG_SP);
-  end = HIGHESTVIRTUALADDRESS;
+
+  // 3. Compartir páginas del STACK copy-on-write
+  bgn = get_page_of_virtual_address(*(get_regs(context) + REG_SP));
+  end = get_page_of_virtual_address(HIGHESTVIRTUALADDRESS);
   while (bgn <= end){
-    if (is_virtual_address_mapped(get_pt(context), bgn))
-      map_and_store(child_context, bgn, load_virtual_memory(get_pt(context), bgn));
-    bgn = bgn + WORDSIZE; // Cambio: usar WORDSIZE en lugar de 1
+    share_page(context, child_context, bgn);
+    bgn = bgn + 1;
   }
 
-  // 6. Copiar registros y PC
+  // 4. Copiar registros y PC
   parent_regs = get_regs(context);
   child_regs = get_regs(child_context);
   it = 0;
@@ -9319,19 +10120,23 @@ void implement_fork(uint64_t *context){ // fork
     it = it + 1;
   }
 
-  // 7. Ajustar valores de retorno en padre e hijo
+  // 5. Ajustar valores de retorno en padre e hijo
   *(parent_regs + REG_A0) = get_id_context(child_context); // Padre retorna su PID
   *(child_regs + REG_A0) = 0; // Hijo retorna 0
 
-  // 8. Avanzar PC en ambos contextos
+  // 6. Avanzar PC en ambos contextos
   set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
   set_pc(child_context, get_pc(child_context) + INSTRUCTIONSIZE);
 
-  // 9. seteo parent_context e hijo a listo para correr
+  // 7. seteo parent_context e hijo a listo para correr
   set_ptr_parent_ctx(child_context, context);
   
-  // CFS: copiar vruntime del padre al hijo
-  set_vruntime(child_context, get_vruntime(context));
+  // CFS: copiar vruntime y nice del padre al hijo
+  update_vruntime(child_context, get_vruntime(context));
+  renice_context(child_context, get_nice(context));
+
+  // stride: el hijo hereda los tickets del padre
+  set_tickets(child_context, get_tickets(context));
 
   if (debug_scheduler)
     printf("[FORK] Parent PID=%lu created child PID=%lu\n", 
@@ -9397,6 +10202,7 @@ void implement_sem_wait(uint64_t* context) {
   uint64_t can_acquire;
 
   sem_addr = *(get_regs(context) + REG_A0);
+  make_resident(context, sem_addr);
   sem_id   = load_virtual_memory(get_pt(context), sem_addr);
   sem      = used_semaphores + (sem_id * SEMAPHOREENTRIES);
 
@@ -9421,7 +10227,7 @@ void implement_sem_wait(uint64_t* context) {
   } else {
     // Caso 2: no hay recursos → bloquear
 
-    set_blocked(context, 1);
+    block_context(context, WAIT_SEMAPHORE, sem_id, sem_addr);
    //  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
 
     if (n < 64) {
@@ -9464,6 +10270,7 @@ void implement_sem_post(uint64_t* context) {
   uint64_t sem_class;
 
   sem_addr = *(get_regs(context) + REG_A0);
+  make_resident(context, sem_addr);
   sem_id   = load_virtual_memory(get_pt(context), sem_addr);
   sem      = used_semaphores + (sem_id * SEMAPHOREENTRIES);
 
@@ -9490,8 +10297,9 @@ void implement_sem_post(uint64_t* context) {
     set_sem_n_waiters(sem, n - 1);
 
     waiter_ctx = find_context_by_id(waiter_pid);
-    if (waiter_ctx != (uint64_t*)0)
-      set_blocked(waiter_ctx, 0);
+    if (waiter_ctx != (uint64_t*)0) {
+      wake_up_context(waiter_ctx);
+    }
 
   }
 
@@ -9552,6 +10360,7 @@ void implement_lock_acquire(uint64_t* context) { // locks
   uint64_t can_acquire;
 
   lock_addr = *(get_regs(context) + REG_A0);
+  make_resident(context, lock_addr);
   lock_id = load_virtual_memory(get_pt(context), lock_addr);
   lock = used_locks + (lock_id * LOCKENTRIES);
 
@@ -9578,7 +10387,7 @@ void implement_lock_acquire(uint64_t* context) { // locks
     set_lock_owner(lock, get_id_context(context));
     set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
   } else {
-    set_blocked(context, 1);
+    block_context(context, WAIT_LOCK, lock_id, lock_addr);
 
     if (n < 64) {
       if (waiters != (uint64_t*)0) {
@@ -9618,6 +10427,7 @@ void implement_lock_release(uint64_t* context) { // locks
   uint64_t lock_class;
 
   lock_addr = *(get_regs(context) + REG_A0);
+  make_resident(context, lock_addr);
   lock_id = load_virtual_memory(get_pt(context), lock_addr);
   lock = used_locks + (lock_id * LOCKENTRIES);
 
@@ -9644,7 +10454,7 @@ void implement_lock_release(uint64_t* context) { // locks
 
     waiter_ctx = find_context_by_id(waiter_pid);
     if (waiter_ctx != (uint64_t*)0) {
-      set_blocked(waiter_ctx, 0);
+      wake_up_context(waiter_ctx);
       set_lock_owner(lock, waiter_pid); 
     }
   } else {
@@ -9658,59 +10468,165 @@ void implement_lock_release(uint64_t* context) { // locks
   set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
 }
 
+void emit_nice() { // CFS: nice
+  create_symbol_table_entry(GLOBAL_TABLE, string_copy("nice"),
+                            0, PROCEDURE, UINT64_T, 1, code_size);
 
-uint64_t down_load_string(uint64_t *context, uint64_t vstring, char *s)
-{
-  return copy_buffer(context, vstring, (uint64_t *)s, 0, 0);
+  emit_load(REG_A0, REG_SP, 0); // nice increment
+  emit_addi(REG_SP, REG_SP, WORDSIZE);
+
+  emit_addi(REG_A7, REG_ZR, SYSCALL_NICE);
+
+  emit_ecall();
+
+  emit_jalr(REG_ZR, REG_RA, 0);
 }
 
-void implement_openat(uint64_t *context)
-{
-  // parameters
-  uint64_t vfilename;
-  uint64_t flags;
-  uint64_t mode;
+void implement_nice(uint64_t *context) {
+  // parameter
+  uint64_t increment;
+
+  uint64_t nice;
 
   if (debug_syscalls)
   {
-    printf("(openat): ");
-    print_register_hexadecimal(REG_A0);
-    printf(",");
-    print_register_hexadecimal(REG_A1);
-    printf(",");
-    print_register_hexadecimal(REG_A2);
-    printf(",");
-    print_register_octal(REG_A3);
+    printf("(nice): ");
+    print_register_value(REG_A0);
     printf(" |- ");
-    print_register_value(REG_A1);
+    print_register_value(REG_A0);
   }
 
-  /* We actually emulate the part of the openat system call here that is
-     implemented by the open system call which is deprecated in Linux.
-     In particular, the first parameter (REG_A0) is ignored here while
-     set to DIRFD_AT_FDCWD in the wrapper for the open library call to
-     make sure openat behaves like open when bootstrapping selfie. */
+  increment = *(get_regs(context) + REG_A0);
 
-  vfilename = *(get_regs(context) + REG_A1);
-  flags = *(get_regs(context) + REG_A2);
-  mode = *(get_regs(context) + REG_A3);
+  // nice levels are signed, clamp increment first to avoid overflow
+  if (signed_less_than(increment, MINNICE - MAXNICE))
+    increment = MINNICE - MAXNICE;
+  else if (signed_less_than(MAXNICE - MINNICE, increment))
+    increment = MAXNICE - MINNICE;
 
-  if (down_load_string(context, vfilename, filename_buffer))
-  {
-    if (flags == LINUX_O_CREAT_TRUNC_WRONLY)
-      // use correct flags for host operating system
-      flags = O_CREAT_TRUNC_WRONLY;
+  nice = get_nice(context) + increment;
 
-    *(get_regs(context) + REG_A0) = open(filename_buffer, flags, mode);
-  }
-  else
-    *(get_regs(context) + REG_A0) = sign_shrink(-1, SYSCALL_BITWIDTH);
+  if (signed_less_than(nice, MINNICE))
+    nice = MINNICE;
+  else if (signed_less_than(MAXNICE, nice))
+    nice = MAXNICE;
 
-  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+  renice_context(context, nice);
 
-  if (debug_open)
-    printf("%s: opened file %s with flags 0x%lX and mode 0o%lo returning file descriptor %lu\n", selfie_name,
-           filename_buffer, flags, mode, sign_extend(*(get_regs(context) + REG_A0), SYSCALL_BITWIDTH));
+  // return new nice level
+  *(get_regs(context) + REG_A0) = nice;
+
+  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+
+  if (debug_syscalls)
+  {
+    printf(" -> ");
+    print_register_value(REG_A0);
+    println();
+  }
+}
+
+void emit_tickets() { // stride: tickets
+  create_symbol_table_entry(GLOBAL_TABLE, string_copy("tickets"),
+                            0, PROCEDURE, UINT64_T, 1, code_size);
+
+  emit_load(REG_A0, REG_SP, 0); // number of tickets
+  emit_addi(REG_SP, REG_SP, WORDSIZE);
+
+  emit_addi(REG_A7, REG_ZR, SYSCALL_TICKETS);
+
+  emit_ecall();
+
+  emit_jalr(REG_ZR, REG_RA, 0);
+}
+
+void implement_tickets(uint64_t *context) {
+  // parameter
+  uint64_t tickets;
+
+  if (debug_syscalls)
+  {
+    printf("(tickets): ");
+    print_register_value(REG_A0);
+    printf(" |- ");
+    print_register_value(REG_A0);
+  }
+
+  tickets = *(get_regs(context) + REG_A0);
+
+  // 0 tickets only queries, a stride is at least 1
+  if (tickets > STRIDE1)
+    tickets = STRIDE1;
+
+  if (tickets > 0)
+    set_tickets(context, tickets);
+
+  // return number of tickets
+  *(get_regs(context) + REG_A0) = get_tickets(context);
+
+  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+
+  if (debug_syscalls)
+  {
+    printf(" -> ");
+    print_register_value(REG_A0);
+    println();
+  }
+}
+
+
+uint64_t down_load_string(uint64_t *context, uint64_t vstring, char *s)
+{
+  return copy_buffer(context, vstring, (uint64_t *)s, 0, 0);
+}
+
+void implement_openat(uint64_t *context)
+{
+  // parameters
+  uint64_t vfilename;
+  uint64_t flags;
+  uint64_t mode;
+
+  if (debug_syscalls)
+  {
+    printf("(openat): ");
+    print_register_hexadecimal(REG_A0);
+    printf(",");
+    print_register_hexadecimal(REG_A1);
+    printf(",");
+    print_register_hexadecimal(REG_A2);
+    printf(",");
+    print_register_octal(REG_A3);
+    printf(" |- ");
+    print_register_value(REG_A1);
+  }
+
+  /* We actually emulate the part of the openat system call here that is
+     implemented by the open system call which is deprecated in Linux.
+     In particular, the first parameter (REG_A0) is ignored here while
+     set to DIRFD_AT_FDCWD in the wrapper for the open library call to
+     make sure openat behaves like open when bootstrapping selfie. */
+
+  vfilename = *(get_regs(context) + REG_A1);
+  flags = *(get_regs(context) + REG_A2);
+  mode = *(get_regs(context) + REG_A3);
+
+  if (down_load_string(context, vfilename, filename_buffer))
+  {
+    if (flags == LINUX_O_CREAT_TRUNC_WRONLY)
+      // use correct flags for host operating system
+      flags = O_CREAT_TRUNC_WRONLY;
+
+    *(get_regs(context) + REG_A0) = open(filename_buffer, flags, mode);
+  }
+  else
+    *(get_regs(context) + REG_A0) = sign_shrink(-1, SYSCALL_BITWIDTH);
+
+  set_pc(context, get_pc(context) + INSTRUCTIONSIZE);
+
+  if (debug_open)
+    printf("%s: opened file %s with flags 0x%lX and mode 0o%lo returning file descriptor %lu\n", selfie_name,
+           filename_buffer, flags, mode, sign_extend(*(get_regs(context) + REG_A0), SYSCALL_BITWIDTH));
 
   if (debug_syscalls)
   {
@@ -9977,6 +10893,15 @@ void implement_switch()
 
 uint64_t *mipster_switch(uint64_t *to_context, uint64_t timeout)
 {
+  if (get_io_ready(to_context) != UINT64_MAX)
+  {
+    // response to I/O is the time from becoming ready after I/O until dispatch
+    set_io_response(to_context, get_io_response(to_context) + charged_instructions - get_io_ready(to_context));
+    set_io_responses(to_context, get_io_responses(to_context) + 1);
+
+    set_io_ready(to_context, UINT64_MAX);
+  }
+
   current_context = do_switch(current_context, to_context, timeout);
 
   run_until_exception();
@@ -10392,18 +11317,68 @@ uint64_t get_root_PDE_offset(uint64_t page)
   // in a two-level page table with 4KB (2^12B) pages as leaf nodes and
   // 64-bit pointers (2^3B), each leaf node accommodates 2^(12-3) PTEs;
   // thus bits 9 through 19 encode the root PDE (page directory entry) offset
-  return page / NUMBEROFLEAFPTES; // right shift by 9 bits
+  if (PAGETABLETREE == 1)
+    return page / NUMBEROFLEAFPTES; // right shift by 9 bits
+  else
+    // in a three-level page table bits 18 and up encode the root PDE offset
+    return page / NUMBEROFLEAFPTES / NUMBEROFLEAFPTES; // right shift by 18 bits
+}
+
+uint64_t get_mid_PDE_offset(uint64_t page)
+{
+  // in a three-level page table bits 9 through 17 encode the mid PDE offset
+  return page / NUMBEROFLEAFPTES - get_root_PDE_offset(page) * NUMBEROFLEAFPTES;
 }
 
 uint64_t get_leaf_PTE_offset(uint64_t page)
 {
   // bits 0 through 8 encode the leaf PTE (page table entry) offset
-  return page - get_root_PDE_offset(page) * NUMBEROFLEAFPTES; // extract the 9 LSBs
+  return page - page / NUMBEROFLEAFPTES * NUMBEROFLEAFPTES; // extract the 9 LSBs
+}
+
+uint64_t get_number_of_root_PDEs()
+{
+  if (PAGETABLETREE == 1)
+    return NUMBEROFPAGES / NUMBEROFLEAFPTES;
+  else
+    // each root PDE covers 1GB with 4KB pages and 64-bit pointers
+    return round_up(NUMBEROFPAGES, NUMBEROFLEAFPTES * NUMBEROFLEAFPTES) / NUMBEROFLEAFPTES / NUMBEROFLEAFPTES;
+}
+
+uint64_t load_page_table_entry(uint64_t *parent_table, uint64_t *entry)
+{
+  if (parent_table == (uint64_t *)0)
+    return *entry;
+  else if (is_virtual_address_mapped(parent_table, (uint64_t)entry))
+    // entry is in address space of parent_table
+    return load_virtual_memory(parent_table, (uint64_t)entry);
+  else
+    return 0;
+}
+
+uint64_t get_PDE_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page)
+{
+  uint64_t mid_pd;
+
+  // returns the lowest PDE on the path to page, which is either a
+  // pointer to a leaf page table or a superpage frame, or 0 if none
+
+  if (PAGETABLETREE == 1)
+    return load_page_table_entry(parent_table, table + get_root_PDE_offset(page));
+  else
+  {
+    mid_pd = load_page_table_entry(parent_table, table + get_root_PDE_offset(page));
+
+    if (mid_pd == 0)
+      return 0;
+    else
+      return load_page_table_entry(parent_table, (uint64_t *)mid_pd + get_mid_PDE_offset(page));
+  }
 }
 
 uint64_t *get_PTE_address_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page)
 {
-  uint64_t *leaf_pt;
+  uint64_t leaf_pt;
 
   // assert: 0 <= page < NUMBEROFPAGES
 
@@ -10412,57 +11387,149 @@ uint64_t *get_PTE_address_for_page(uint64_t *parent_table, uint64_t *table, uint
     return table + page;
   else
   {
-    // to get leaf page table, root page directory access is required!
-    if (parent_table == (uint64_t *)0)
-      leaf_pt = (uint64_t *)*(table + get_root_PDE_offset(page));
-    else
-      // table is in address space of parent_table
-      leaf_pt = (uint64_t *)load_virtual_memory(parent_table, (uint64_t)(table + get_root_PDE_offset(page)));
+    // to get leaf page table, page directory access is required!
+    leaf_pt = get_PDE_for_page(parent_table, table, page);
 
-    if (leaf_pt == (uint64_t *)0)
+    if (leaf_pt == 0)
+      return (uint64_t *)0;
+    else if (leaf_pt % PAGESIZE == PTE_SUPERPAGE)
+      // pages of superpages have no PTE
       return (uint64_t *)0;
     else
       // again, just pointer arithmetic, no access!
-      return leaf_pt + get_leaf_PTE_offset(page);
+      return (uint64_t *)leaf_pt + get_leaf_PTE_offset(page);
   }
 }
 
-uint64_t get_frame_for_page(uint64_t *table, uint64_t page)
+uint64_t load_PTE_for_page(uint64_t *parent_table, uint64_t *table, uint64_t page)
 {
+  uint64_t PDE;
   uint64_t *PTE_address;
 
-  PTE_address = get_PTE_address_for_page(0, table, page);
+  if (PAGETABLETREE == 2)
+  {
+    PDE = get_PDE_for_page(parent_table, table, page);
+
+    if (PDE % PAGESIZE == PTE_SUPERPAGE)
+    {
+      if (parent_table == (uint64_t *)0)
+        // single word on 32-bit target occupies double word on 64-bit system
+        return PDE - PTE_SUPERPAGE + get_leaf_PTE_offset(page) * PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
+      else
+        // frames of hosted contexts are in address space of parent_table
+        return PDE - PTE_SUPERPAGE + get_leaf_PTE_offset(page) * PAGESIZE;
+    }
+  }
+
+  PTE_address = get_PTE_address_for_page(parent_table, table, page);
 
   if (PTE_address == (uint64_t *)0)
     return 0;
   else
-    return (uint64_t)*PTE_address;
+    return load_page_table_entry(parent_table, PTE_address);
 }
 
-void set_PTE_for_page(uint64_t *table, uint64_t page, uint64_t frame)
+uint64_t get_PTE_for_page(uint64_t *table, uint64_t page)
 {
-  uint64_t root_PDE_offset;
+  return load_PTE_for_page((uint64_t *)0, table, page);
+}
+
+uint64_t get_frame_for_page(uint64_t *table, uint64_t page)
+{
+  uint64_t PTE;
+
+  PTE = get_PTE_for_page(table, page);
+
+  if (has_PTE_flag(PTE, PTE_SWAPPED))
+    // swap slot is no frame
+    return 0;
+
+  // strip flags from page-aligned frame
+  return PTE - PTE % PAGESIZE;
+}
+
+uint64_t *get_leaf_pt_for_page(uint64_t *table, uint64_t page)
+{
+  uint64_t *mid_pd;
   uint64_t *leaf_pt;
+  uint64_t superframe;
+  uint64_t i;
 
-  // assert: 0 <= page < NUMBEROFPAGES
+  // returns leaf page table of page, allocating page directories on demand
 
-  if (PAGETABLETREE == 0)
-    *(table + page) = frame;
+  if (PAGETABLETREE == 1)
+    mid_pd = table + get_root_PDE_offset(page);
   else
   {
-    root_PDE_offset = get_root_PDE_offset(page);
+    mid_pd = (uint64_t *)*(table + get_root_PDE_offset(page));
+
+    if (mid_pd == (uint64_t *)0)
+    {
+      mid_pd = palloc(); // 4KB mid page directory
+
+      *(table + get_root_PDE_offset(page)) = (uint64_t)mid_pd;
+    }
+
+    mid_pd = mid_pd + get_mid_PDE_offset(page);
+  }
+
+  leaf_pt = (uint64_t *)*mid_pd;
+
+  if (leaf_pt == (uint64_t *)0)
+  {
+    leaf_pt = palloc(); // 4KB leaf page table
+
+    *mid_pd = (uint64_t)leaf_pt;
+  }
+  else if ((uint64_t)leaf_pt % PAGESIZE == PTE_SUPERPAGE)
+  {
+    // split superpage into its pages before mapping any of them individually
+    superframe = (uint64_t)leaf_pt - PTE_SUPERPAGE;
+
+    leaf_pt = palloc();
 
-    leaf_pt = (uint64_t *)*(table + root_PDE_offset);
+    i = 0;
 
-    if (leaf_pt == (uint64_t *)0)
+    while (i < NUMBEROFLEAFPTES)
     {
-      leaf_pt = palloc(); // 4KB leaf page table
+      // single word on 32-bit target occupies double word on 64-bit system
+      *(leaf_pt + i) = superframe + i * PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
 
-      *(table + root_PDE_offset) = (uint64_t)leaf_pt;
+      i = i + 1;
     }
 
-    *(leaf_pt + get_leaf_PTE_offset(page)) = frame;
+    *mid_pd = (uint64_t)leaf_pt;
+  }
+
+  return leaf_pt;
+}
+
+void set_PTE_for_page(uint64_t *table, uint64_t page, uint64_t frame)
+{
+  // assert: 0 <= page < NUMBEROFPAGES
+
+  if (PAGETABLETREE == 0)
+    *(table + page) = frame;
+  else
+    *(get_leaf_pt_for_page(table, page) + get_leaf_PTE_offset(page)) = frame;
+}
+
+void set_PDE_for_superpage(uint64_t *table, uint64_t page, uint64_t superframe)
+{
+  uint64_t *mid_pd;
+
+  // assert: PAGETABLETREE == 2 and no page of superpage is mapped
+
+  mid_pd = (uint64_t *)*(table + get_root_PDE_offset(page));
+
+  if (mid_pd == (uint64_t *)0)
+  {
+    mid_pd = palloc(); // 4KB mid page directory
+
+    *(table + get_root_PDE_offset(page)) = (uint64_t)mid_pd;
   }
+
+  *(mid_pd + get_mid_PDE_offset(page)) = superframe + PTE_SUPERPAGE;
 }
 
 uint64_t is_page_mapped(uint64_t *table, uint64_t page)
@@ -10473,6 +11540,105 @@ uint64_t is_page_mapped(uint64_t *table, uint64_t page)
     return 0;
 }
 
+uint64_t is_page_writable(uint64_t *table, uint64_t page)
+{
+  uint64_t PTE;
+
+  PTE = get_PTE_for_page(table, page);
+
+  if (PTE == 0)
+    return 0;
+  else if (has_PTE_flag(PTE, PTE_SWAPPED))
+    return 0;
+  else if (has_PTE_flag(PTE, PTE_READONLY))
+    return 0;
+  else
+    return 1;
+}
+
+uint64_t is_page_swapped(uint64_t *table, uint64_t page)
+{
+  return has_PTE_flag(get_PTE_for_page(table, page), PTE_SWAPPED);
+}
+
+uint64_t has_PTE_flag(uint64_t PTE, uint64_t flag)
+{
+  // assert: flag is a power of 2 less than PAGESIZE
+  if (PTE % (flag * 2) >= flag)
+    return 1;
+  else
+    return 0;
+}
+
+uint64_t get_PTE_usage_bits(uint64_t PTE)
+{
+  uint64_t bits;
+
+  bits = 0;
+
+  if (has_PTE_flag(PTE, PTE_ACCESSED))
+    bits = bits + PTE_ACCESSED;
+  if (has_PTE_flag(PTE, PTE_DIRTY))
+    bits = bits + PTE_DIRTY;
+  if (has_PTE_flag(PTE, PTE_TRACKED))
+    bits = bits + PTE_TRACKED;
+
+  return bits;
+}
+
+void set_PTE_flag(uint64_t *table, uint64_t page, uint64_t flag)
+{
+  uint64_t *PTE_address;
+
+  PTE_address = get_PTE_address_for_page((uint64_t *)0, table, page);
+
+  // pages of superpages have no PTE to keep flags in
+  if (PTE_address != (uint64_t *)0)
+    if (has_PTE_flag(*PTE_address, flag) == 0)
+      *PTE_address = *PTE_address + flag;
+}
+
+void clear_PTE_flag(uint64_t *table, uint64_t page, uint64_t flag)
+{
+  uint64_t *PTE_address;
+
+  PTE_address = get_PTE_address_for_page((uint64_t *)0, table, page);
+
+  if (PTE_address != (uint64_t *)0)
+    if (has_PTE_flag(*PTE_address, flag))
+      *PTE_address = *PTE_address - flag;
+}
+
+void set_PTE_usage_bit(uint64_t *table, uint64_t page, uint64_t flag)
+{
+  uint64_t *parent_table;
+  uint64_t *PTE_address;
+  uint64_t PTE;
+
+  set_PTE_flag(table, page, flag);
+
+  // like walkers of nested page tables, usage bits of hosted contexts
+  // are also set in the guest page table for the guest kernel to see
+  if (table == pt)
+    if (get_parent(current_context) != MY_CONTEXT)
+    {
+      parent_table = get_pt(get_parent(current_context));
+
+      PTE_address = get_PTE_address_for_page(parent_table,
+        (uint64_t *)load_virtual_memory(parent_table, page_table(get_virtual_context(current_context))), page);
+
+      if (PTE_address != (uint64_t *)0)
+        if (is_virtual_address_mapped(parent_table, (uint64_t)PTE_address))
+        {
+          PTE = load_virtual_memory(parent_table, (uint64_t)PTE_address);
+
+          if (PTE != 0)
+            if (has_PTE_flag(PTE, flag) == 0)
+              store_virtual_memory(parent_table, (uint64_t)PTE_address, PTE + flag);
+        }
+    }
+}
+
 uint64_t get_page_of_virtual_address(uint64_t vaddr)
 {
   return vaddr / PAGESIZE;
@@ -10501,33 +11667,125 @@ uint64_t is_virtual_address_mapped(uint64_t *table, uint64_t vaddr)
   return is_page_mapped(table, get_page_of_virtual_address(vaddr));
 }
 
-uint64_t *tlb(uint64_t *table, uint64_t vaddr)
+uint64_t is_virtual_address_writable(uint64_t *table, uint64_t vaddr)
 {
-  uint64_t page;
-  uint64_t frame;
-  uint64_t paddr;
-
   // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
-  // assert: is_virtual_address_mapped(table, vaddr) == 1
 
-  page = get_page_of_virtual_address(vaddr);
+  return is_page_writable(table, get_page_of_virtual_address(vaddr));
+}
 
-  frame = get_frame_for_page(table, page);
+void init_tlb()
+{
+  TLB = zmalloc(TLBENTRIES * TLBENTRYSIZE * sizeof(uint64_t));
 
-  // map virtual address to physical address
-  // (single word on 32-bit target occupies double word on 64-bit system)
-  paddr = (vaddr - page * PAGESIZE) * (sizeof(uint64_t) / WORDSIZE) + frame;
+  tlb_hits = 0;
+  tlb_misses = 0;
+}
 
-  if (debug_tlb)
-    printf("%s: tlb access:\n vaddr: 0x%08lX\n page: 0x%04lX\n frame: 0x%08lX\n paddr: 0x%08lX\n", selfie_name,
-           vaddr,
-           page,
+void flush_tlb()
+{
+  uint64_t i;
+
+  i = 0;
+
+  while (i < TLBENTRIES * TLBENTRYSIZE)
+  {
+    *(TLB + i) = 0;
+
+    i = i + TLBENTRYSIZE;
+  }
+}
+
+void invalidate_tlb_page(uint64_t *table, uint64_t page)
+{
+  uint64_t *entry;
+
+  entry = TLB + page % TLBENTRIES * TLBENTRYSIZE;
+
+  if (*entry == (uint64_t)table)
+    if (*(entry + 1) == page)
+      *entry = 0;
+}
+
+uint64_t *tlb(uint64_t *table, uint64_t vaddr)
+{
+  uint64_t page;
+  uint64_t frame;
+  uint64_t paddr;
+  uint64_t *entry;
+
+  // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
+  // assert: is_virtual_address_mapped(table, vaddr) == 1
+
+  page = get_page_of_virtual_address(vaddr);
+
+  entry = TLB + page % TLBENTRIES * TLBENTRYSIZE;
+
+  frame = 0;
+
+  if (*entry == (uint64_t)table)
+    if (*(entry + 1) == page)
+      frame = *(entry + 2);
+
+  if (frame != 0)
+    tlb_hits = tlb_hits + 1;
+  else
+  {
+    tlb_misses = tlb_misses + 1;
+
+    // walk page table and cache translation
+    frame = get_frame_for_page(table, page);
+
+    if (frame != 0)
+    {
+      *entry = (uint64_t)table;
+      *(entry + 1) = page;
+      *(entry + 2) = frame;
+      *(entry + 3) = 0;
+
+      if (USAGEBITS)
+        // like hardware page table walkers on TLB refill
+        set_PTE_usage_bit(table, page, PTE_ACCESSED);
+    }
+  }
+
+  // map virtual address to physical address
+  // (single word on 32-bit target occupies double word on 64-bit system)
+  paddr = (vaddr - page * PAGESIZE) * (sizeof(uint64_t) / WORDSIZE) + frame;
+
+  if (debug_tlb)
+    printf("%s: tlb access:\n vaddr: 0x%08lX\n page: 0x%04lX\n frame: 0x%08lX\n paddr: 0x%08lX\n", selfie_name,
+           vaddr,
+           page,
            frame,
            paddr);
 
   return (uint64_t *)paddr;
 }
 
+uint64_t *tlb_for_store(uint64_t *table, uint64_t vaddr)
+{
+  uint64_t *paddr;
+  uint64_t *entry;
+
+  paddr = tlb(table, vaddr);
+
+  if (USAGEBITS)
+  {
+    entry = TLB + get_page_of_virtual_address(vaddr) % TLBENTRIES * TLBENTRYSIZE;
+
+    // set dirty bit in page table only on first store through TLB entry
+    if (*(entry + 3) == 0)
+    {
+      *(entry + 3) = 1;
+
+      set_PTE_usage_bit(table, get_page_of_virtual_address(vaddr), PTE_DIRTY);
+    }
+  }
+
+  return paddr;
+}
+
 uint64_t load_virtual_memory(uint64_t *table, uint64_t vaddr)
 {
   // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
@@ -10541,27 +11799,25 @@ void store_virtual_memory(uint64_t *table, uint64_t vaddr, uint64_t data)
   // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
   // assert: is_virtual_address_mapped(table, vaddr) == 1
 
-  store_physical_memory(tlb(table, vaddr), data);
+  store_physical_memory(tlb_for_store(table, vaddr), data);
 }
 
 uint64_t load_cached_virtual_memory(uint64_t *table, uint64_t vaddr)
 {
-  if (L1_CACHE_ENABLED)
-    // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
-    // assert: is_virtual_address_mapped(table, vaddr) == 1
-    return load_data_from_cache(vaddr, (uint64_t)tlb(table, vaddr));
-  else
-    return load_virtual_memory(table, vaddr);
+  // assert: L1_CACHE_ENABLED == 1
+  // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
+  // assert: is_virtual_address_mapped(table, vaddr) == 1
+
+  return load_data_from_cache(vaddr, (uint64_t)tlb(table, vaddr));
 }
 
 void store_cached_virtual_memory(uint64_t *table, uint64_t vaddr, uint64_t data)
 {
-  if (L1_CACHE_ENABLED)
-    // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
-    // assert: is_virtual_address_mapped(table, vaddr) == 1
-    store_data_in_cache(vaddr, (uint64_t)tlb(table, vaddr), data);
-  else
-    store_virtual_memory(table, vaddr, data);
+  // assert: L1_CACHE_ENABLED == 1
+  // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
+  // assert: is_virtual_address_mapped(table, vaddr) == 1
+
+  store_data_in_cache(vaddr, (uint64_t)tlb_for_store(table, vaddr), data);
 }
 
 uint64_t load_cached_instruction_word(uint64_t *table, uint64_t vaddr)
@@ -10574,6 +11830,120 @@ uint64_t load_cached_instruction_word(uint64_t *table, uint64_t vaddr)
     return load_virtual_memory(table, vaddr);
 }
 
+uint64_t *find_shared_frame(uint64_t frame)
+{
+  uint64_t *entry;
+
+  entry = (uint64_t *)*(shared_frames + frame / PAGESIZE % SHAREDFRAMEBUCKETS);
+
+  while (entry != (uint64_t *)0)
+  {
+    if (get_shared_frame(entry) == frame)
+      return entry;
+
+    entry = get_next_shared_frame(entry);
+  }
+
+  return (uint64_t *)0;
+}
+
+uint64_t get_frame_references(uint64_t frame)
+{
+  uint64_t *entry;
+
+  entry = find_shared_frame(frame);
+
+  if (entry == (uint64_t *)0)
+    return 1;
+  else
+    return get_shared_frame_references(entry);
+}
+
+void reference_frame(uint64_t frame)
+{
+  uint64_t *bucket;
+  uint64_t *entry;
+
+  entry = find_shared_frame(frame);
+
+  if (entry == (uint64_t *)0)
+  {
+    bucket = shared_frames + frame / PAGESIZE % SHAREDFRAMEBUCKETS;
+
+    if (free_shared_frames != (uint64_t *)0)
+    {
+      entry = free_shared_frames;
+
+      free_shared_frames = get_next_shared_frame(entry);
+    }
+    else
+      entry = smalloc(SHAREDFRAMEENTRIES * sizeof(uint64_t));
+
+    set_next_shared_frame(entry, (uint64_t *)*bucket);
+    set_shared_frame(entry, frame);
+    set_shared_frame_references(entry, 1);
+    set_shared_frame_pinned(entry, 0);
+
+    *bucket = (uint64_t)entry;
+  }
+
+  set_shared_frame_references(entry, get_shared_frame_references(entry) + 1);
+}
+
+void unreference_frame(uint64_t frame)
+{
+  uint64_t *bucket;
+  uint64_t *entry;
+
+  entry = find_shared_frame(frame);
+
+  if (entry != (uint64_t *)0)
+  {
+    set_shared_frame_references(entry, get_shared_frame_references(entry) - 1);
+
+    if (get_shared_frame_references(entry) == 1)
+    {
+      // frame is no longer shared
+      bucket = shared_frames + frame / PAGESIZE % SHAREDFRAMEBUCKETS;
+
+      if ((uint64_t *)*bucket == entry)
+        *bucket = (uint64_t)get_next_shared_frame(entry);
+      else
+      {
+        bucket = (uint64_t *)*bucket;
+
+        while (get_next_shared_frame(bucket) != entry)
+          bucket = get_next_shared_frame(bucket);
+
+        set_next_shared_frame(bucket, get_next_shared_frame(entry));
+      }
+
+      set_next_shared_frame(entry, free_shared_frames);
+
+      free_shared_frames = entry;
+    }
+  }
+}
+
+void pin_frame(uint64_t frame)
+{
+  // assert: frame is shared, that is, referenced at least twice
+
+  set_shared_frame_pinned(find_shared_frame(frame), 1);
+}
+
+uint64_t is_frame_pinned(uint64_t frame)
+{
+  uint64_t *entry;
+
+  entry = find_shared_frame(frame);
+
+  if (entry == (uint64_t *)0)
+    return 0;
+  else
+    return get_shared_frame_pinned(entry);
+}
+
 // -----------------------------------------------------------------
 // ---------------------- GARBAGE COLLECTOR ------------------------
 // -----------------------------------------------------------------
@@ -10674,6 +12044,8 @@ void implement_gc_brk(uint64_t *context)
     // assert: _bump pointer is last entry in data segment
 
     // updating the _bump pointer of the program (for consistency)
+    make_writable(context, get_data_seg_end_gc(context) - WORDSIZE);
+
     store_virtual_memory(get_pt(context), get_data_seg_end_gc(context) - WORDSIZE, get_program_break(context));
 
     // assert: gc_brk syscall is invoked by selfie's malloc
@@ -10891,11 +12263,15 @@ uint64_t gc_load_memory(uint64_t *context, uint64_t address)
   if (is_gc_library(context))
     return *((uint64_t *)address);
   else
+  {
     // assert: is_virtual_address_valid(address, WORDSIZE) == 1
+    make_resident(context, address);
+
     if (is_virtual_address_mapped(get_pt(context), address))
       return load_virtual_memory(get_pt(context), address);
     else
       return 0;
+  }
 }
 
 void gc_store_memory(uint64_t *context, uint64_t address, uint64_t value)
@@ -10905,7 +12281,11 @@ void gc_store_memory(uint64_t *context, uint64_t address, uint64_t value)
   else
     // assert: is_virtual_address_valid(address, WORDSIZE) == 1
     if (is_virtual_address_mapped(get_pt(context), address))
+    {
+      make_writable(context, address);
+
       store_virtual_memory(get_pt(context), address, value);
+    }
 }
 
 void zero_object(uint64_t *context, uint64_t *metadata)
@@ -11685,7 +13065,7 @@ uint64_t do_load()
         if (rd != REG_ZR)
         {
           // semantics of load (double) word
-          next_rd_value = load_cached_virtual_memory(pt, vaddr);
+          next_rd_value = load_virtual_memory(pt, vaddr);
 
           if (*(registers + rd) != next_rd_value)
             *(registers + rd) = next_rd_value;
@@ -11788,23 +13168,17 @@ uint64_t do_store()
   {
     if (is_valid_segment_write(vaddr))
     {
-      if (is_virtual_address_mapped(pt, vaddr))
+      if (is_virtual_address_writable(pt, vaddr))
       {
         // tolerate storing unwrapped values
         read_register_check_wrap(rs2, 0);
 
         // semantics of store (double) word
         if (load_virtual_memory(pt, vaddr) != *(registers + rs2))
-          store_cached_virtual_memory(pt, vaddr, *(registers + rs2));
+          store_virtual_memory(pt, vaddr, *(registers + rs2));
         else
-        {
           nopc_store = nopc_store + 1;
 
-          if (L1_CACHE_ENABLED)
-            // effective nop still changes the cache state
-            store_cached_virtual_memory(pt, vaddr, *(registers + rs2));
-        }
-
         // keep track of instruction address for profiling stores
         a = (pc - code_start) / INSTRUCTIONSIZE;
 
@@ -12093,10 +13467,14 @@ void do_ecall()
                     if (a7 != SYSCALL_COUNT_SYSCALLS){
                       if (a7 != SYSCALL_DUMMY){
                         if (a7 != SYSCALL_BRK){
+                          if (a7 != SYSCALL_NICE){
+                            if (a7 != SYSCALL_TICKETS){
                               read_register(REG_A1);
                               read_register(REG_A2);
 
                             if (a7 == SYSCALL_OPENAT) read_register(REG_A3);
+                            }
+                          }
                         }
                       }
                     }
@@ -12560,15 +13938,7 @@ void decode()
 
 void execute()
 {
-  if (debug)
-  {
-    if (record)
-      execute_record();
-    else
-      execute_debug();
-
-    return;
-  }
+  // profiling variant, the others are selected in run_until_exception
 
   // assert: 1 <= is <= number of RISC-U instructions
   if (is == ADDI)
@@ -12601,37 +13971,362 @@ void execute()
     do_ecall();
 }
 
-void execute_record()
+void shrink_register(uint64_t reg)
 {
-  // assert: 1 <= is <= number of RISC-U instructions
-  if (is == ADDI)
+  // lean counterpart of write_register without profiling
+  if (SIZEOFUINT64INBITS != WORDSIZEINBITS)
+    *(registers + reg) = sign_shrink(*(registers + reg), WORDSIZEINBITS);
+}
+
+uint64_t do_lean_load()
+{
+  uint64_t vaddr;
+
+  // lean counterpart of do_load without profiling and cache simulation
+
+  vaddr = *(registers + rs1) + imm;
+
+  if (is_virtual_address_valid(vaddr, WORDSIZE))
   {
-    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
-    do_addi();
+    if (is_data_stack_heap_address(current_context, vaddr))
+    {
+      if (is_virtual_address_mapped(pt, vaddr))
+      {
+        if (rd != REG_ZR)
+          *(registers + rd) = load_virtual_memory(pt, vaddr);
+
+        pc = pc + INSTRUCTIONSIZE;
+      }
+      else
+        throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
+    }
+    else
+      throw_exception(EXCEPTION_SEGMENTATIONFAULT, vaddr);
   }
-  else if (is == LOAD)
+  else
+    throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
+
+  return vaddr;
+}
+
+uint64_t do_lean_store()
+{
+  uint64_t vaddr;
+
+  // lean counterpart of do_store without profiling and cache simulation
+
+  vaddr = *(registers + rs1) + imm;
+
+  if (is_virtual_address_valid(vaddr, WORDSIZE))
   {
-    record_load();
-    do_load();
+    if (is_data_stack_heap_address(current_context, vaddr))
+    {
+      if (is_virtual_address_writable(pt, vaddr))
+      {
+        store_virtual_memory(pt, vaddr, *(registers + rs2));
+
+        pc = pc + INSTRUCTIONSIZE;
+      }
+      else
+        throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
+    }
+    else
+      throw_exception(EXCEPTION_SEGMENTATIONFAULT, vaddr);
   }
-  else if (is == STORE)
+  else
+    throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
+
+  return vaddr;
+}
+
+void execute_lean()
+{
+  uint64_t next_pc;
+
+  // production variant of execute: same semantics but no instruction,
+  // nop, register, segment, call and loop counters, no checks for
+  // uninitialized registers and unwrapped values, and no cache simulation
+
+  // assert: 1 <= is <= number of RISC-U instructions
+  if (is == ADDI)
   {
-    record_store();
-    do_store();
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = *(registers + rs1) + imm;
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
   }
+  else if (is == LOAD)
+    do_lean_load();
+  else if (is == STORE)
+    do_lean_store();
   else if (is == ADD)
   {
-    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
-    do_add();
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = *(registers + rs1) + *(registers + rs2);
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
   }
   else if (is == SUB)
   {
-    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
-    do_sub();
-  }
-  else if (is == MUL)
-  {
-    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = *(registers + rs1) - *(registers + rs2);
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (is == MUL)
+  {
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = *(registers + rs1) * *(registers + rs2);
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (is == DIVU)
+  {
+    if (*(registers + rs2) != 0)
+    {
+      if (rd != REG_ZR)
+      {
+        *(registers + rd) = *(registers + rs1) / *(registers + rs2);
+
+        shrink_register(rd);
+      }
+
+      pc = pc + INSTRUCTIONSIZE;
+    }
+    else
+      throw_exception(EXCEPTION_DIVISIONBYZERO, pc);
+  }
+  else if (is == REMU)
+  {
+    if (*(registers + rs2) != 0)
+    {
+      if (rd != REG_ZR)
+      {
+        *(registers + rd) = *(registers + rs1) % *(registers + rs2);
+
+        shrink_register(rd);
+      }
+
+      pc = pc + INSTRUCTIONSIZE;
+    }
+    else
+      throw_exception(EXCEPTION_DIVISIONBYZERO, pc);
+  }
+  else if (is == SLTU)
+  {
+    if (rd != REG_ZR)
+    {
+      if (*(registers + rs1) < *(registers + rs2))
+        *(registers + rd) = 1;
+      else
+        *(registers + rd) = 0;
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (is == BEQ)
+  {
+    if (*(registers + rs1) == *(registers + rs2))
+      pc = pc + imm;
+    else
+      pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (is == JAL)
+  {
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = pc + INSTRUCTIONSIZE;
+
+      shrink_register(rd);
+    }
+
+    pc = pc + imm;
+  }
+  else if (is == JALR)
+  {
+    next_pc = left_shift(right_shift(*(registers + rs1) + imm, 1), 1);
+
+    if (rd != REG_ZR)
+    {
+      // link to next instruction (works even if rd == rs1)
+      *(registers + rd) = pc + INSTRUCTIONSIZE;
+
+      shrink_register(rd);
+    }
+
+    pc = next_pc;
+  }
+  else if (is == LUI)
+  {
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = left_shift(imm, 12);
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (is == ECALL)
+    do_ecall();
+}
+
+uint64_t do_cached_load()
+{
+  uint64_t vaddr;
+  uint64_t next_rd_value;
+  uint64_t a;
+
+  // cache-simulating counterpart of do_load
+
+  read_register(rs1);
+
+  vaddr = *(registers + rs1) + imm;
+
+  if (is_virtual_address_valid(vaddr, WORDSIZE))
+  {
+    if (is_valid_segment_read(vaddr))
+    {
+      if (is_virtual_address_mapped(pt, vaddr))
+      {
+        if (rd != REG_ZR)
+        {
+          next_rd_value = load_cached_virtual_memory(pt, vaddr);
+
+          if (*(registers + rd) != next_rd_value)
+            *(registers + rd) = next_rd_value;
+          else
+            nopc_load = nopc_load + 1;
+        }
+        else
+          nopc_load = nopc_load + 1;
+
+        write_register_wrap(rd, 0);
+
+        a = (pc - code_start) / INSTRUCTIONSIZE;
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_load = ic_load + 1;
+
+        *(loads_per_instruction + a) = *(loads_per_instruction + a) + 1;
+      }
+      else
+        throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
+    }
+    else
+      throw_exception(EXCEPTION_SEGMENTATIONFAULT, vaddr);
+  }
+  else
+    throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
+
+  return vaddr;
+}
+
+uint64_t do_cached_store()
+{
+  uint64_t vaddr;
+  uint64_t a;
+
+  // cache-simulating counterpart of do_store
+
+  read_register(rs1);
+
+  vaddr = *(registers + rs1) + imm;
+
+  if (is_virtual_address_valid(vaddr, WORDSIZE))
+  {
+    if (is_valid_segment_write(vaddr))
+    {
+      if (is_virtual_address_writable(pt, vaddr))
+      {
+        read_register_check_wrap(rs2, 0);
+
+        if (load_virtual_memory(pt, vaddr) == *(registers + rs2))
+          nopc_store = nopc_store + 1;
+
+        // effective nop still changes the cache state
+        store_cached_virtual_memory(pt, vaddr, *(registers + rs2));
+
+        a = (pc - code_start) / INSTRUCTIONSIZE;
+
+        pc = pc + INSTRUCTIONSIZE;
+
+        ic_store = ic_store + 1;
+
+        *(stores_per_instruction + a) = *(stores_per_instruction + a) + 1;
+      }
+      else
+        throw_exception(EXCEPTION_PAGEFAULT, get_page_of_virtual_address(vaddr));
+    }
+    else
+      throw_exception(EXCEPTION_SEGMENTATIONFAULT, vaddr);
+  }
+  else
+    throw_exception(EXCEPTION_INVALIDADDRESS, vaddr);
+
+  return vaddr;
+}
+
+void execute_cached()
+{
+  // cache-simulating variant of execute: profiling plus
+  // memory accesses through the L1 data cache
+  if (is == LOAD)
+    do_cached_load();
+  else if (is == STORE)
+    do_cached_store();
+  else
+    execute();
+}
+
+void execute_record()
+{
+  // assert: 1 <= is <= number of RISC-U instructions
+  if (is == ADDI)
+  {
+    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
+    do_addi();
+  }
+  else if (is == LOAD)
+  {
+    record_load();
+    do_load();
+  }
+  else if (is == STORE)
+  {
+    record_store();
+    do_store();
+  }
+  else if (is == ADD)
+  {
+    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
+    do_add();
+  }
+  else if (is == SUB)
+  {
+    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
+    do_sub();
+  }
+  else if (is == MUL)
+  {
+    record_lui_addi_add_sub_mul_divu_remu_sltu_jal_jalr();
     do_mul();
   }
   else if (is == DIVU)
@@ -12781,11 +14476,16 @@ void execute_debug()
   println();
 }
 
-void interrupt()
+void charge_timer(uint64_t instructions)
 {
+  // charges timer for a number of executed instructions at once
+  // assert: instructions <= timer if timer is on
+
+  charged_instructions = charged_instructions + instructions;
+
   if (timer != TIMEROFF)
   {
-    timer = timer - 1;
+    timer = timer - instructions;
 
     if (timer == 0)
     {
@@ -12800,1350 +14500,4756 @@ void interrupt()
   }
 }
 
-void run_until_exception()
+void interrupt()
 {
-  trap = 0;
+  charge_timer(1);
+}
 
-  while (trap == 0)
+void fetch_and_decode_cached()
+{
+  uint64_t *entry;
+  uint64_t ids;
+
+  if (is_code_address(current_context, pc) == 0)
   {
+    // let fetch throw the exception
     fetch();
     decode();
-    execute();
 
-    interrupt();
+    return;
   }
+  else if (pc % INSTRUCTIONSIZE != 0)
+  {
+    fetch();
+    decode();
 
-  trap = 0;
-}
-
-uint64_t instruction_with_max_counter(uint64_t *counters, uint64_t max)
-{
-  uint64_t a;
-  uint64_t n;
-  uint64_t i;
-  uint64_t c;
+    return;
+  }
 
-  a = UINT64_MAX;
+  entry = get_decoded_instruction(decoded_code, (pc - get_code_seg_start(current_context)) / INSTRUCTIONSIZE);
 
-  n = 0;
-  i = 0;
+  ids = get_decoded_ids(entry);
 
-  while (i < code_size / INSTRUCTIONSIZE)
+  if (ids == 0)
   {
-    c = *(counters + i);
+    fetch();
+    decode();
 
-    if (n < c)
+    // only cache successfully decoded instructions
+    if (is != 0)
     {
-      if (c < max)
-      {
-        n = c;
-        a = i;
-      }
-      else
-        return i * INSTRUCTIONSIZE;
+      set_decoded_ir(entry, ir);
+      set_decoded_ids(entry, is + (rd + (rs1 + rs2 * 32) * 32) * 16);
+      set_decoded_imm(entry, imm);
     }
 
-    i = i + 1;
+    return;
   }
 
-  if (a != UINT64_MAX)
-    return a * INSTRUCTIONSIZE;
-  else
-    return UINT64_MAX;
+  // cache simulation does not use decoded instructions
+  ir = get_decoded_ir(entry);
+
+  is = ids % 16;
+  ids = ids / 16;
+  rd = ids % 32;
+  ids = ids / 32;
+  rs1 = ids % 32;
+  rs2 = ids / 32;
+
+  imm = get_decoded_imm(entry);
 }
 
-uint64_t print_per_instruction_counter(uint64_t total, uint64_t *counters, uint64_t max)
+void run_until_exception()
 {
-  uint64_t a;
-  uint64_t c;
-
-  a = instruction_with_max_counter(counters, max);
+  uint64_t executed;
 
-  if (a != UINT64_MAX)
+  // the execution variant is selected once per run, not per instruction
+  if (basic_blocks)
   {
-    c = *(counters + a / INSTRUCTIONSIZE);
+    run_basic_blocks_until_exception();
 
-    // CAUTION: we reset counter to avoid reporting it again
-    *(counters + a / INSTRUCTIONSIZE) = 0;
+    return;
+  }
+  else if (lean)
+  {
+    run_lean_until_exception();
 
-    printf(",%lu(%lu.%.2lu%%)@0x%lX", c,
-           percentage_format_integral_2(total, c),
-           percentage_format_fractional_2(total, c), a);
-    if (code_line_number != (uint64_t *)0)
-      printf("(~%lu)", *(code_line_number + a / INSTRUCTIONSIZE));
+    return;
+  }
+  else if (debug)
+  {
+    run_instrumented_until_exception();
 
-    return c;
+    return;
   }
-  else
+  else if (L1_CACHE_ENABLED)
   {
-    printf(",0(0.00%%)");
+    run_instrumented_until_exception();
 
-    return 0;
+    return;
   }
-}
 
-void print_per_instruction_profile(char *message, uint64_t total, uint64_t *counters)
-{
-  printf("%s: %s%lu", selfie_name, message, total);
-  print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, UINT64_MAX)));
-  println();
-}
+  trap = 0;
 
-void print_access_profile(char *message, char *padding, uint64_t reads, uint64_t writes)
-{
-  if (reads + writes > 0)
+  // number of executed instructions not yet charged to timer,
+  // the timer is a deadline on this counter which is charged only
+  // when the timer expires, before system calls, and upon exceptions
+  executed = 0;
+
+  while (trap == 0)
   {
-    if (writes == 0)
-      // may happen in read-only memory segments
-      writes = 1;
+    fetch_and_decode_cached();
 
-    printf("%s: %s%s%lu,%lu,%lu[%lu.%.2lu]\n", selfie_name, message, padding,
-           reads + writes, reads, writes,
-           ratio_format_integral_2(reads, writes),
-           ratio_format_fractional_2(reads, writes));
+    if (is == ECALL)
+    {
+      // system calls may switch context and thus reset the timer
+      charge_timer(executed);
+
+      executed = 0;
+
+      execute();
+
+      interrupt();
+    }
+    else
+    {
+      execute();
+
+      executed = executed + 1;
+
+      // never true if timer is off since executed > TIMEROFF
+      if (executed == timer)
+      {
+        // preempts at exactly the same instruction as stepping the timer
+        charge_timer(executed);
+
+        executed = 0;
+      }
+    }
   }
-}
 
-void print_per_register_profile(uint64_t reg)
-{
-  print_access_profile(get_register_name(reg), " register:   ", *(reads_per_register + reg), *(writes_per_register + reg));
+  charge_timer(executed);
+
+  trap = 0;
 }
 
-void print_register_memory_profile()
+void run_lean_until_exception()
 {
-  uint64_t reg;
-
-  printf("%s: CPU+memory:    reads+writes,reads,writes[reads/writes]\n", selfie_name);
+  uint64_t executed;
 
-  print_access_profile("heap segment:  ", "", heap_reads, heap_writes);
+  // lean counterpart of run_until_exception
 
-  print_per_register_profile(REG_GP);
-  print_access_profile("data segment:  ", "", data_reads, data_writes);
+  trap = 0;
 
-  reg = 1;
+  executed = 0;
 
-  while (reg < NUMBEROFREGISTERS)
+  while (trap == 0)
   {
-    if (is_stack_register(reg))
+    fetch_and_decode_cached();
+
+    if (is == ECALL)
     {
-      stack_register_reads = stack_register_reads + *(reads_per_register + reg);
-      stack_register_writes = stack_register_writes + *(writes_per_register + reg);
+      charge_timer(executed);
 
-      print_per_register_profile(reg);
+      executed = 0;
+
+      execute_lean();
+
+      interrupt();
     }
+    else
+    {
+      execute_lean();
 
-    reg = reg + 1;
+      executed = executed + 1;
+
+      if (executed == timer)
+      {
+        charge_timer(executed);
+
+        executed = 0;
+      }
+    }
   }
 
-  print_access_profile("stack total:   ", "", stack_register_reads, stack_register_writes);
-  print_access_profile("stack segment: ", "", stack_reads, stack_writes);
+  charge_timer(executed);
 
-  reg = 1;
+  trap = 0;
+}
 
-  while (reg < NUMBEROFREGISTERS)
+void run_instrumented_until_exception()
+{
+  // debugger, replay engine, and cache simulation fetch every
+  // instruction from memory and step the timer per instruction
+
+  trap = 0;
+
+  while (trap == 0)
   {
-    if (is_argument_register(reg))
-    {
-      argument_register_reads = argument_register_reads + *(reads_per_register + reg);
-      argument_register_writes = argument_register_writes + *(writes_per_register + reg);
+    fetch();
+    decode();
 
-      print_per_register_profile(reg);
+    if (debug)
+    {
+      if (record)
+        execute_record();
+      else
+        execute_debug();
     }
+    else
+      execute_cached();
 
-    reg = reg + 1;
+    interrupt();
   }
 
-  print_access_profile("args total:    ", "", argument_register_reads, argument_register_writes);
+  trap = 0;
+}
 
-  reg = 1;
+uint64_t walk_basic_block(uint64_t *context, uint64_t index, uint64_t trace, uint64_t *block)
+{
+  uint64_t *code;
+  uint64_t length;
+  uint64_t next;
+  uint64_t done;
+  uint64_t ids;
+  uint64_t *entry;
+  uint64_t *instruction;
 
-  while (reg < NUMBEROFREGISTERS)
+  // returns the number of instructions in the block starting at index,
+  // and copies them into block if block is not null
+
+  code = get_decoded_code(context);
+
+  length = 0;
+
+  // code segment offset of next instruction
+  next = index * INSTRUCTIONSIZE;
+
+  done = 0;
+
+  while (done == 0)
   {
-    if (is_temporary_register(reg))
+    if (next >= get_code_seg_size(context))
+      done = 1;
+    else
     {
-      temporary_register_reads = temporary_register_reads + *(reads_per_register + reg);
-      temporary_register_writes = temporary_register_writes + *(writes_per_register + reg);
+      entry = get_decoded_instruction(code, next / INSTRUCTIONSIZE);
 
-      print_per_register_profile(reg);
-    }
+      ids = get_decoded_ids(entry);
 
-    reg = reg + 1;
+      if (ids == 0)
+      {
+        // only translate instructions that have already been decoded
+        // so that translation never throws exceptions
+        if (trace == 0)
+          return 0;
+
+        // traces end before the first instruction not yet decoded
+        done = 1;
+      }
+      else
+      {
+        if (block != (uint64_t *)0)
+        {
+          instruction = get_block_instruction(block, length);
+
+          *instruction = ids % 16;
+          *(instruction + 1) = (ids / 16) % 32;
+          *(instruction + 2) = (ids / 16 / 32) % 32;
+          *(instruction + 3) = ids / 16 / 32 / 32;
+          *(instruction + 4) = get_decoded_imm(entry);
+          *(instruction + 5) = get_decoded_ir(entry);
+        }
+
+        length = length + 1;
+
+        if (ids % 16 == JAL)
+        {
+          // control always continues at jump target
+          next = next + get_decoded_imm(entry);
+
+          done = 1;
+
+          if (trace)
+            // hot traces follow direct jumps
+            if (length < MAXTRACELENGTH)
+              if (next % INSTRUCTIONSIZE == 0)
+                done = 0;
+        }
+        else
+        {
+          next = next + INSTRUCTIONSIZE;
+
+          if (ids % 16 >= BEQ)
+            // assert: BEQ < JAL < JALR < ECALL are the last instruction IDs
+            done = 1;
+        }
+      }
+    }
   }
 
-  print_access_profile("temps total:   ", "", temporary_register_reads, temporary_register_writes);
+  if (block != (uint64_t *)0)
+    set_block_end(block, get_code_seg_start(context) + next);
+
+  return length;
 }
 
-void down_load_profiles()
+uint64_t *translate_basic_block(uint64_t *context, uint64_t index, uint64_t trace)
 {
-  uint64_t *context;
-  uint64_t *parent_table;
-  uint64_t *vctxt;
+  uint64_t length;
+  uint64_t *block;
 
-  context = used_contexts;
+  length = walk_basic_block(context, index, trace, (uint64_t *)0);
 
-  while (context != (uint64_t *)0)
+  if (length == 0)
+    return (uint64_t *)0;
+
+  block = zmalloc((BASICBLOCKENTRIES + length * BLOCKINSTRUCTIONENTRIES) * sizeof(uint64_t));
+
+  set_block_start(block, get_code_seg_start(context) + index * INSTRUCTIONSIZE);
+  set_block_length(block, length);
+
+  walk_basic_block(context, index, trace, block);
+
+  fuse_basic_block(block);
+
+  set_block_next(block, translated_block_list);
+
+  translated_block_list = block;
+
+  return block;
+}
+
+uint64_t *find_basic_block()
+{
+  uint64_t index;
+  uint64_t *block;
+
+  if (is_code_address(current_context, pc) == 0)
+    return (uint64_t *)0;
+  else if (pc % INSTRUCTIONSIZE != 0)
+    return (uint64_t *)0;
+
+  if (get_basic_blocks(current_context) == (uint64_t *)0)
+    set_basic_blocks(current_context, zmalloc(get_code_seg_size(current_context) / INSTRUCTIONSIZE * sizeof(uint64_t *)));
+
+  index = (pc - get_code_seg_start(current_context)) / INSTRUCTIONSIZE;
+
+  block = (uint64_t *)*(get_basic_blocks(current_context) + index);
+
+  if (block == (uint64_t *)0)
   {
-    if (get_parent(context) != MY_CONTEXT)
+    block = translate_basic_block(current_context, index, 0);
+
+    if (block != (uint64_t *)0)
     {
-      parent_table = get_pt(get_parent(context));
-      vctxt = get_virtual_context(context);
+      *(get_basic_blocks(current_context) + index) = (uint64_t)block;
 
-      set_lc_malloc(context, load_virtual_memory(parent_table, lc_malloc(vctxt)));
-      set_mc_mapped_heap(context, load_virtual_memory(parent_table, mc_mapped_heap(vctxt)));
-      set_ec_syscall(context, load_virtual_memory(parent_table, ec_syscall(vctxt)));
-      set_ec_page_fault(context, load_virtual_memory(parent_table, ec_page_fault(vctxt)));
-      set_ec_timer(context, load_virtual_memory(parent_table, ec_timer(vctxt)));
+      translated_blocks = translated_blocks + 1;
     }
-
-    context = get_next_context(context);
   }
+
+  return block;
 }
 
-void print_instruction_versus_exception_profile(uint64_t *parent_context)
+uint64_t *next_basic_block(uint64_t *block)
 {
-  uint64_t ic_count;
-  uint64_t ec_count;
-  uint64_t *context;
+  uint64_t *next;
 
-  printf("%s:          %lu executed instructions [%lu.%.2lu%% share, factor %lu.%.2lu]\n", selfie_name,
-         get_ic_all(parent_context),
-         percentage_format_integral_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
-         percentage_format_fractional_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
-         ratio_format_integral_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
-         ratio_format_fractional_2(get_total_number_of_instructions(), get_ic_all(parent_context)));
+  if (block == (uint64_t *)0)
+    return find_basic_block();
+  else if (*get_block_instruction(block, get_block_length(block) - 1) == ECALL)
+    // system calls may switch contexts
+    return find_basic_block();
+  else if (pc == get_block_end(block))
+  {
+    next = get_block_fall_through(block);
 
-  ic_count = 0;
-  ec_count = 0;
+    if (next == (uint64_t *)0)
+    {
+      next = find_basic_block();
 
-  context = used_contexts;
+      set_block_fall_through(block, next);
 
-  while (context != (uint64_t *)0)
+      return next;
+    }
+  }
+  else
   {
-    if (get_parent(context) == parent_context)
+    next = get_block_taken(block);
+
+    if (next == (uint64_t *)0)
     {
-      ic_count = ic_count + get_ic_all(context);
-      ec_count = ec_count +
-                 get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context);
+      next = find_basic_block();
+
+      set_block_taken(block, next);
+
+      return next;
     }
+    else if (get_block_start(next) != pc)
+    {
+      // indirect jumps may leave block to different successors
+      next = find_basic_block();
 
-    context = get_next_context(context);
+      set_block_taken(block, next);
+
+      return next;
+    }
   }
 
-  if (ec_count > 0)
-    // assert: get_ic_all(parent_context) > 0
-    printf("%s:          %lu exceptions handled by %lu instructions each [%lu.%.2lu%% overhead, factor %lu.%.2lu]\n", selfie_name,
-           ec_count,
-           ratio_format_integral_2(get_ic_all(parent_context), ec_count),
-           percentage_format_integral_2(ic_count, get_ic_all(parent_context)),
-           percentage_format_fractional_2(ic_count, get_ic_all(parent_context)),
-           ratio_format_integral_2(get_ic_all(parent_context), ic_count) + 1,
-           ratio_format_fractional_2(get_ic_all(parent_context), ic_count));
+  chained_blocks = chained_blocks + 1;
+
+  return next;
 }
 
-void print_profile()
+void compile_hot_block(uint64_t *block)
 {
-  uint64_t *context;
+  uint64_t index;
+  uint64_t *trace;
 
-  printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
-  printf("%s: summary: ", selfie_name);
-  if (get_total_number_of_instructions() > 0)
+  // there is no native code generation in selfie, instead hot blocks
+  // are compiled into traces that continue across direct jumps
+
+  index = (get_block_start(block) - get_code_seg_start(current_context)) / INSTRUCTIONSIZE;
+
+  // only allocate a trace that is longer than the block
+  if (walk_basic_block(current_context, index, 1, (uint64_t *)0) > get_block_length(block))
   {
-    printf("%lu executed instructions in total [%lu.%.2lu%% nops]\n",
-           get_total_number_of_instructions(),
-           percentage_format_integral_2(get_total_number_of_instructions(), get_total_number_of_nops()),
-           percentage_format_fractional_2(get_total_number_of_instructions(), get_total_number_of_nops()));
-    printf("%s:          ", selfie_name);
+    trace = translate_basic_block(current_context, index, 1);
+
+    set_block_trace(trace, trace);
+    set_block_trace(block, trace);
+
+    hot_traces = hot_traces + 1;
   }
-  printf("%lu.%.2luMB mapped memory [%lu.%.2lu%% of %luMB physical memory]\n",
-         ratio_format_integral_2(pused(), MEGABYTE),
-         ratio_format_fractional_2(pused(), MEGABYTE),
-         percentage_format_integral_2(PHYSICALMEMORYSIZE, pused()),
-         percentage_format_fractional_2(PHYSICALMEMORYSIZE, pused()),
-         PHYSICALMEMORYSIZE / MEGABYTE);
+  else
+    // block does not end in a direct jump, keep using it
+    set_block_trace(block, block);
+}
 
-  down_load_profiles();
+void fuse_basic_block(uint64_t *block)
+{
+  uint64_t i;
+  uint64_t *first;
+  uint64_t *second;
+  uint64_t fusion;
 
-  context = used_contexts;
+  // the last instruction of a block is never fused since it may
+  // switch context, or leave the block, and thus reset the timer
 
-  while (context != (uint64_t *)0)
-  {
-    printf("%s: ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n", selfie_name);
-    printf("%s: context: %s\n", selfie_name, get_name(context));
-    if (get_ic_all(context) > 0)
+  i = 0;
+
+  while (i + 2 < get_block_length(block))
+  {
+    first = get_block_instruction(block, i);
+    second = get_block_instruction(block, i + 1);
+
+    fusion = 0;
+
+    if (*first == LOAD)
     {
-      print_instruction_versus_exception_profile(context);
-      printf("%s:          %lu.%.2luKB peak stack size\n", selfie_name,
-             ratio_format_integral_2(VIRTUALMEMORYSIZE * GIGABYTE - get_mc_stack_peak(context), KILOBYTE),
-             ratio_format_fractional_2(VIRTUALMEMORYSIZE * GIGABYTE - get_mc_stack_peak(context), KILOBYTE));
-      printf("%s:          %lu.%.2luMB allocated in %lu mallocs (%lu.%.2luMB or %lu.%.2lu%% actually accessed)\n", selfie_name,
-             ratio_format_integral_2(get_program_break(context) - get_heap_seg_start(context), MEGABYTE),
-             ratio_format_fractional_2(get_program_break(context) - get_heap_seg_start(context), MEGABYTE),
-             get_lc_malloc(context),
-             ratio_format_integral_2(get_mc_mapped_heap(context), MEGABYTE),
-             ratio_format_fractional_2(get_mc_mapped_heap(context), MEGABYTE),
-             percentage_format_integral_2(round_up(get_program_break(context) - get_heap_seg_start(context), PAGESIZE),
-                                          get_mc_mapped_heap(context)),
-             percentage_format_fractional_2(round_up(get_program_break(context) - get_heap_seg_start(context), PAGESIZE),
-                                            get_mc_mapped_heap(context)));
+      if (*second == ADDI)
+        if (*(second + 1) == *(first + 2))
+          if (*(second + 2) == *(first + 2))
+            // base register must not be overwritten by load
+            if (*(first + 1) != *(first + 2))
+              if (*(first + 2) != REG_ZR)
+                fusion = FUSEDLOADADDI;
     }
-    if (get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context) > 0)
+    else if (*first == LUI)
     {
-      printf("%s:          %lu exceptions handled by ", selfie_name,
-             get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context));
-      if (get_parent(context) == MY_CONTEXT)
-        printf("%s", selfie_name);
-      else
-        printf("%s", get_name(get_parent(context)));
-      if (get_ic_all(context) > 0)
-        printf(", one every %lu executed instructions",
-               ratio_format_integral_2(get_ic_all(context),
-                                       get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context)));
-      println();
-      printf("%s:          %lu syscalls, %lu page faults, %lu timer interrupts\n", selfie_name,
-             get_ec_syscall(context),
-             get_ec_page_fault(context),
-             get_ec_timer(context));
+      if (*second == ADDI)
+        if (*(second + 1) == *(first + 1))
+          if (*(second + 2) == *(first + 1))
+            fusion = FUSEDLUIADDI;
+    }
+    else if (*first == ADDI)
+    {
+      if (*second == STORE)
+        if (*(first + 1) == *(first + 2))
+          if (*(second + 2) == *(first + 1))
+            fusion = FUSEDADDISTORE;
     }
 
-    context = get_next_context(context);
+    if (fusion != 0)
+    {
+      set_instruction_fusion(first, fusion);
+
+      i = i + 2;
+    }
+    else
+      i = i + 1;
   }
+}
 
-  if (GC_ON)
+void load_block_instruction(uint64_t *instruction)
+{
+  is = *instruction;
+  rd = *(instruction + 1);
+  rs1 = *(instruction + 2);
+  rs2 = *(instruction + 3);
+  imm = *(instruction + 4);
+  ir = *(instruction + 5);
+}
+
+uint64_t execute_superinstruction(uint64_t *instruction)
+{
+  uint64_t fusion;
+
+  // executes a fused instruction pair and returns the number of
+  // executed instructions which is less than two upon exceptions
+
+  fusion = get_instruction_fusion(instruction);
+
+  // the fused handlers of the profiling variant are the original ones
+  // so that profile counters are still attributed per instruction
+
+  load_block_instruction(instruction);
+
+  if (fusion == FUSEDLOADADDI)
   {
-    printf("%s: ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n", selfie_name);
-    print_gc_profile(1);
+    do_load();
+
+    if (trap)
+      return 1;
+
+    load_block_instruction(instruction + BLOCKINSTRUCTIONENTRIES);
+
+    do_addi();
+
+    fused_pops = fused_pops + 1;
   }
+  else if (fusion == FUSEDLUIADDI)
+  {
+    do_lui();
 
-  if (get_total_number_of_instructions() > 0)
+    load_block_instruction(instruction + BLOCKINSTRUCTIONENTRIES);
+
+    do_addi();
+
+    fused_constants = fused_constants + 1;
+  }
+  else if (fusion == FUSEDADDISTORE)
   {
-    print_instruction_counters();
+    do_addi();
 
-    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
-    if (code_line_number != (uint64_t *)0)
-      printf("%s: profile: total,max(ratio%%)@address(line#),2ndmax,3rdmax\n", selfie_name);
-    else
-      printf("%s: profile: total,max(ratio%%)@address,2ndmax,3rdmax\n", selfie_name);
-    print_per_instruction_profile("calls:   ", calls, calls_per_procedure);
-    print_per_instruction_profile("loops:   ", iterations, iterations_per_loop);
-    print_per_instruction_profile("loads:   ", ic_load, loads_per_instruction);
-    print_per_instruction_profile("stores:  ", ic_store, stores_per_instruction);
+    load_block_instruction(instruction + BLOCKINSTRUCTIONENTRIES);
 
-    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
-    print_register_memory_profile();
+    do_store();
+
+    fused_pushes = fused_pushes + 1;
   }
 
-  if (L1_CACHE_ENABLED)
+  return 2;
+}
+
+uint64_t execute_lean_superinstruction(uint64_t *instruction)
+{
+  uint64_t fusion;
+  uint64_t *second;
+
+  fusion = get_instruction_fusion(instruction);
+
+  second = instruction + BLOCKINSTRUCTIONENTRIES;
+
+  load_block_instruction(instruction);
+
+  if (fusion == FUSEDLOADADDI)
   {
-    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
-    printf("%s: L1 caches:     accesses,hits,misses\n", selfie_name);
+    do_lean_load();
 
-    print_cache_profile(get_cache_hits(L1_DCACHE), get_cache_misses(L1_DCACHE), "data:          ");
-    println();
+    if (trap)
+      return 1;
 
-    print_cache_profile(get_cache_hits(L1_ICACHE), get_cache_misses(L1_ICACHE), "instruction:   ");
-    if (L1_CACHE_COHERENCY)
-      printf(" (coherency invalidations: %lu)", L1_icache_coherency_invalidations);
-    println();
+    // base register is incremented by immediate of addi
+    *(registers + rs1) = *(registers + rs1) + *(second + 4);
+
+    shrink_register(rs1);
+
+    pc = pc + INSTRUCTIONSIZE;
+  }
+  else if (fusion == FUSEDLUIADDI)
+  {
+    if (rd != REG_ZR)
+    {
+      // upper and lower part of constant in one step
+      *(registers + rd) = left_shift(imm, 12) + *(second + 4);
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE + INSTRUCTIONSIZE;
+  }
+  else if (fusion == FUSEDADDISTORE)
+  {
+    if (rd != REG_ZR)
+    {
+      *(registers + rd) = *(registers + rd) + imm;
+
+      shrink_register(rd);
+    }
+
+    pc = pc + INSTRUCTIONSIZE;
+
+    load_block_instruction(second);
+
+    do_lean_store();
+
+    return 2;
   }
+
+  load_block_instruction(second);
+
+  return 2;
 }
 
-void print_host_os()
+void execute_basic_block(uint64_t *block)
 {
-  if (OS == SELFIE)
-    printf("selfie");
-  else if (OS == LINUX)
-    printf("Linux");
-  else if (OS == MACOS)
-    printf("macOS");
-  else if (OS == WINDOWS)
-    printf("Windows");
-  else if (OS == BAREMETAL)
-    printf("bare metal");
-  else
-    printf("unknown");
-}
+  uint64_t length;
+  uint64_t timed;
+  uint64_t i;
+  uint64_t *instruction;
+  uint64_t fusion;
 
-// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
-// -----------------------------------------------------------------
-// ----------------------    R U N T I M E    ----------------------
-// -----------------------------------------------------------------
-// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+  if (lean)
+  {
+    // the execution variant is selected once per block, not per instruction
+    execute_lean_basic_block(block);
 
-// -----------------------------------------------------------------
-// ------------------------ MACHINE CONTEXTS -----------------------
-// -----------------------------------------------------------------
+    return;
+  }
 
-uint64_t *new_context()
-{
-  uint64_t *context;
+  length = get_block_length(block);
 
-  if (free_contexts == (uint64_t *)0)
-    context = allocate_context();
-  else
+  // step timer through block only if it may expire in block
+  timed = 0;
+
+  if (timer != TIMEROFF)
+    if (timer <= length)
+      timed = 1;
+
+  i = 0;
+
+  while (i < length)
   {
-    context = free_contexts;
+    if (timed == 0)
+      if (i + 1 == length)
+        // charge timer once for all instructions but the last one
+        // which may switch context and thus reset the timer
+        charge_timer(i);
 
-    free_contexts = get_next_context(free_contexts);
+    instruction = get_block_instruction(block, i);
+
+    if (timed == 0)
+      fusion = get_instruction_fusion(instruction);
+    else
+      // timer may expire in between fused instructions
+      fusion = 0;
+
+    if (fusion != 0)
+      i = i + execute_superinstruction(instruction);
+    else
+    {
+      load_block_instruction(instruction);
+
+      execute();
+
+      i = i + 1;
+    }
+
+    if (timed)
+      interrupt();
+    else if (i == length)
+      interrupt();
+    else if (trap)
+      charge_timer(i);
+
+    if (trap)
+      return;
   }
+}
 
-  set_next_context(context, used_contexts);
-  set_prev_context(context, (uint64_t *)0);
+void execute_lean_basic_block(uint64_t *block)
+{
+  uint64_t length;
+  uint64_t timed;
+  uint64_t i;
+  uint64_t *instruction;
+  uint64_t fusion;
 
-  if (used_contexts != (uint64_t *)0)
-    set_prev_context(used_contexts, context);
+  // lean counterpart of execute_basic_block
 
-  used_contexts = context;
+  length = get_block_length(block);
 
-  return context;
+  timed = 0;
+
+  if (timer != TIMEROFF)
+    if (timer <= length)
+      timed = 1;
+
+  i = 0;
+
+  while (i < length)
+  {
+    if (timed == 0)
+      if (i + 1 == length)
+        charge_timer(i);
+
+    instruction = get_block_instruction(block, i);
+
+    if (timed == 0)
+      fusion = get_instruction_fusion(instruction);
+    else
+      fusion = 0;
+
+    if (fusion != 0)
+      i = i + execute_lean_superinstruction(instruction);
+    else
+    {
+      load_block_instruction(instruction);
+
+      execute_lean();
+
+      i = i + 1;
+    }
+
+    if (timed)
+      interrupt();
+    else if (i == length)
+      interrupt();
+    else if (trap)
+      charge_timer(i);
+
+    if (trap)
+      return;
+  }
 }
 
-void init_context(uint64_t *context, uint64_t *parent, uint64_t *vctxt)
+void run_basic_blocks_until_exception()
 {
-  char *context_name;
+  uint64_t *block;
 
-  // some fields are set in boot loader or when context switching
+  trap = 0;
 
-  // allocate zeroed memory for general-purpose registers
-  // TODO: reuse memory
-  set_regs(context, zmalloc(NUMBEROFREGISTERS * sizeof(uint64_t)));
+  block = (uint64_t *)0;
 
-  // allocate zeroed memory for page table
-  // TODO: save and reuse memory for page table
-  if (PAGETABLETREE == 0)
-    // for a 4GB-virtual-memory page table with
-    // 4KB pages and 64-bit pointers, allocate
-    // 8MB = 2^23 ((2^32 / 2^12) * 2^3) bytes to
-    // accommodate 2^20 (2^32 / 2^12) PTEs
-    set_pt(context, zmalloc(NUMBEROFPAGES * sizeof(uint64_t *)));
-  else
-    // for the root node (page directory), allocate
-    // 16KB = 2^14 (2^32 / 2^12 / 2^9 * 2^3) bytes to
-    // accommodate 2^11 ((2^32 / 2^12) / 2^9) root PDEs
-    // pointing to 4KB leaf nodes (page tables) that
-    // each accommodate 2^9 (2^12 / 2^3) leaf PTEs
-    set_pt(context, zmalloc(NUMBEROFPAGES / NUMBEROFLEAFPTES * sizeof(uint64_t *)));
+  while (trap == 0)
+  {
+    block = next_basic_block(block);
 
-  // reset page table cache
-  set_lowest_lo_page(context, 0);
-  set_highest_lo_page(context, get_lowest_lo_page(context));
-  set_lowest_hi_page(context, get_page_of_virtual_address(HIGHESTVIRTUALADDRESS));
-  set_highest_hi_page(context, get_lowest_hi_page(context));
+    if (block != (uint64_t *)0)
+    {
+      if (get_block_trace(block) == (uint64_t *)0)
+        if (get_block_executions(block) + 1 == HOTBLOCKTHRESHOLD)
+          compile_hot_block(block);
 
-  if (parent != MY_CONTEXT)
-  {// Si parent no es el kernel
-    set_code_seg_start(context, load_virtual_memory(get_pt(parent), code_seg_start(vctxt)));
-    set_code_seg_size(context, load_virtual_memory(get_pt(parent), code_seg_size(vctxt)));
-    set_data_seg_start(context, load_virtual_memory(get_pt(parent), data_seg_start(vctxt)));
-    set_data_seg_size(context, load_virtual_memory(get_pt(parent), data_seg_size(vctxt)));
-    set_heap_seg_start(context, load_virtual_memory(get_pt(parent), heap_seg_start(vctxt)));
+      if (get_block_trace(block) != (uint64_t *)0)
+        block = get_block_trace(block);
 
-    context_name = string_alloc(MAX_FILENAME_LENGTH);
+      // executions of traces are counted for n-gram profiling
+      set_block_executions(block, get_block_executions(block) + 1);
 
-    down_load_string(parent, load_virtual_memory(get_pt(parent), name(vctxt)), context_name);
+      execute_basic_block(block);
 
-    set_name(context, context_name);
+      executed_blocks = executed_blocks + 1;
+    }
+    else
+    {
+      // code not translatable yet, decode and execute single instruction
+      fetch_and_decode_cached();
+
+      if (lean)
+        execute_lean();
+      else
+        execute();
+
+      interrupt();
+    }
   }
-  else
-  { // Si parent es el kernel
-    set_exception(context, EXCEPTION_NOEXCEPTION);
-    set_fault(context, 0);
 
-    set_exit_code(context, EXITCODE_NOERROR);
-  }
+  trap = 0;
+}
+
+uint64_t instruction_with_max_counter(uint64_t *counters, uint64_t max)
+{
+  uint64_t a;
+  uint64_t n;
+  uint64_t i;
+  uint64_t c;
+
+  a = UINT64_MAX;
+
+  n = 0;
+  i = 0;
+
+  while (i < code_size / INSTRUCTIONSIZE)
+  {
+    c = *(counters + i);
+
+    if (n < c)
+    {
+      if (c < max)
+      {
+        n = c;
+        a = i;
+      }
+      else
+        return i * INSTRUCTIONSIZE;
+    }
+
+    i = i + 1;
+  }
+
+  if (a != UINT64_MAX)
+    return a * INSTRUCTIONSIZE;
+  else
+    return UINT64_MAX;
+}
+
+uint64_t print_per_instruction_counter(uint64_t total, uint64_t *counters, uint64_t max)
+{
+  uint64_t a;
+  uint64_t c;
+
+  a = instruction_with_max_counter(counters, max);
+
+  if (a != UINT64_MAX)
+  {
+    c = *(counters + a / INSTRUCTIONSIZE);
+
+    // CAUTION: we reset counter to avoid reporting it again
+    *(counters + a / INSTRUCTIONSIZE) = 0;
+
+    printf(",%lu(%lu.%.2lu%%)@0x%lX", c,
+           percentage_format_integral_2(total, c),
+           percentage_format_fractional_2(total, c), a);
+    if (code_line_number != (uint64_t *)0)
+      printf("(~%lu)", *(code_line_number + a / INSTRUCTIONSIZE));
+
+    return c;
+  }
+  else
+  {
+    printf(",0(0.00%%)");
+
+    return 0;
+  }
+}
+
+void print_per_instruction_profile(char *message, uint64_t total, uint64_t *counters)
+{
+  printf("%s: %s%lu", selfie_name, message, total);
+  print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, print_per_instruction_counter(total, counters, UINT64_MAX)));
+  println();
+}
+
+void print_access_profile(char *message, char *padding, uint64_t reads, uint64_t writes)
+{
+  if (reads + writes > 0)
+  {
+    if (writes == 0)
+      // may happen in read-only memory segments
+      writes = 1;
+
+    printf("%s: %s%s%lu,%lu,%lu[%lu.%.2lu]\n", selfie_name, message, padding,
+           reads + writes, reads, writes,
+           ratio_format_integral_2(reads, writes),
+           ratio_format_fractional_2(reads, writes));
+  }
+}
+
+void print_per_register_profile(uint64_t reg)
+{
+  print_access_profile(get_register_name(reg), " register:   ", *(reads_per_register + reg), *(writes_per_register + reg));
+}
+
+void print_register_memory_profile()
+{
+  uint64_t reg;
+
+  printf("%s: CPU+memory:    reads+writes,reads,writes[reads/writes]\n", selfie_name);
+
+  print_access_profile("heap segment:  ", "", heap_reads, heap_writes);
+
+  print_per_register_profile(REG_GP);
+  print_access_profile("data segment:  ", "", data_reads, data_writes);
+
+  reg = 1;
+
+  while (reg < NUMBEROFREGISTERS)
+  {
+    if (is_stack_register(reg))
+    {
+      stack_register_reads = stack_register_reads + *(reads_per_register + reg);
+      stack_register_writes = stack_register_writes + *(writes_per_register + reg);
+
+      print_per_register_profile(reg);
+    }
+
+    reg = reg + 1;
+  }
+
+  print_access_profile("stack total:   ", "", stack_register_reads, stack_register_writes);
+  print_access_profile("stack segment: ", "", stack_reads, stack_writes);
+
+  reg = 1;
+
+  while (reg < NUMBEROFREGISTERS)
+  {
+    if (is_argument_register(reg))
+    {
+      argument_register_reads = argument_register_reads + *(reads_per_register + reg);
+      argument_register_writes = argument_register_writes + *(writes_per_register + reg);
+
+      print_per_register_profile(reg);
+    }
+
+    reg = reg + 1;
+  }
+
+  print_access_profile("args total:    ", "", argument_register_reads, argument_register_writes);
+
+  reg = 1;
+
+  while (reg < NUMBEROFREGISTERS)
+  {
+    if (is_temporary_register(reg))
+    {
+      temporary_register_reads = temporary_register_reads + *(reads_per_register + reg);
+      temporary_register_writes = temporary_register_writes + *(writes_per_register + reg);
+
+      print_per_register_profile(reg);
+    }
+
+    reg = reg + 1;
+  }
+
+  print_access_profile("temps total:   ", "", temporary_register_reads, temporary_register_writes);
+}
+
+void down_load_profiles()
+{
+  uint64_t *context;
+  uint64_t *parent_table;
+  uint64_t *vctxt;
+
+  context = used_contexts;
+
+  while (context != (uint64_t *)0)
+  {
+    if (get_parent(context) != MY_CONTEXT)
+      // memory of exited parent has been reclaimed
+      if (get_blocked(get_parent(context)) != 2)
+      {
+        parent_table = get_pt(get_parent(context));
+        vctxt = get_virtual_context(context);
+
+        set_lc_malloc(context, load_virtual_memory(parent_table, lc_malloc(vctxt)));
+        set_mc_mapped_heap(context, load_virtual_memory(parent_table, mc_mapped_heap(vctxt)));
+        set_ec_syscall(context, load_virtual_memory(parent_table, ec_syscall(vctxt)));
+        set_ec_page_fault(context, load_virtual_memory(parent_table, ec_page_fault(vctxt)));
+        set_ec_timer(context, load_virtual_memory(parent_table, ec_timer(vctxt)));
+      }
+
+    context = get_next_context(context);
+  }
+}
+
+void print_instruction_versus_exception_profile(uint64_t *parent_context)
+{
+  uint64_t ic_count;
+  uint64_t ec_count;
+  uint64_t *context;
+
+  printf("%s:          %lu executed instructions [%lu.%.2lu%% share, factor %lu.%.2lu]\n", selfie_name,
+         get_ic_all(parent_context),
+         percentage_format_integral_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
+         percentage_format_fractional_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
+         ratio_format_integral_2(get_total_number_of_instructions(), get_ic_all(parent_context)),
+         ratio_format_fractional_2(get_total_number_of_instructions(), get_ic_all(parent_context)));
+
+  ic_count = 0;
+  ec_count = 0;
+
+  context = used_contexts;
+
+  while (context != (uint64_t *)0)
+  {
+    if (get_parent(context) == parent_context)
+    {
+      ic_count = ic_count + get_ic_all(context);
+      ec_count = ec_count +
+                 get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context);
+    }
+
+    context = get_next_context(context);
+  }
+
+  if (ec_count > 0)
+    // assert: get_ic_all(parent_context) > 0
+    printf("%s:          %lu exceptions handled by %lu instructions each [%lu.%.2lu%% overhead, factor %lu.%.2lu]\n", selfie_name,
+           ec_count,
+           ratio_format_integral_2(get_ic_all(parent_context), ec_count),
+           percentage_format_integral_2(ic_count, get_ic_all(parent_context)),
+           percentage_format_fractional_2(ic_count, get_ic_all(parent_context)),
+           ratio_format_integral_2(get_ic_all(parent_context), ic_count) + 1,
+           ratio_format_fractional_2(get_ic_all(parent_context), ic_count));
+}
+
+void print_profile()
+{
+  uint64_t *context;
+  uint64_t completed;
+  uint64_t turnaround;
+  uint64_t response;
+  uint64_t responses;
+
+  printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+  printf("%s: summary: ", selfie_name);
+  if (get_total_number_of_instructions() > 0)
+  {
+    printf("%lu executed instructions in total [%lu.%.2lu%% nops]\n",
+           get_total_number_of_instructions(),
+           percentage_format_integral_2(get_total_number_of_instructions(), get_total_number_of_nops()),
+           percentage_format_fractional_2(get_total_number_of_instructions(), get_total_number_of_nops()));
+    printf("%s:          ", selfie_name);
+  }
+  printf("%lu.%.2luMB mapped memory [%lu.%.2lu%% of %luMB physical memory]\n",
+         ratio_format_integral_2(peak_page_frame_memory, MEGABYTE),
+         ratio_format_fractional_2(peak_page_frame_memory, MEGABYTE),
+         percentage_format_integral_2(PHYSICALMEMORYSIZE, peak_page_frame_memory),
+         percentage_format_fractional_2(PHYSICALMEMORYSIZE, peak_page_frame_memory),
+         PHYSICALMEMORYSIZE / MEGABYTE);
+  printf("%s:          %lu.%.2luMB still in use, %lu.%.2luMB on free list after reclaiming %lu frames",
+         selfie_name,
+         ratio_format_integral_2(pused(), MEGABYTE),
+         ratio_format_fractional_2(pused(), MEGABYTE),
+         ratio_format_integral_2(reclaimed_page_frame_memory, MEGABYTE),
+         ratio_format_fractional_2(reclaimed_page_frame_memory, MEGABYTE),
+         reclaimed_frames);
+  if (pavailable() == 0)
+    printf(" (out of physical memory)");
+  println();
+  if (copied_frames > 0)
+    printf("%s:          %lu.%.2luMB copied on write in %lu frames\n", selfie_name,
+           ratio_format_integral_2(copied_frames * PAGESIZE, MEGABYTE),
+           ratio_format_fractional_2(copied_frames * PAGESIZE, MEGABYTE),
+           copied_frames);
+  if (page_ins + page_outs + clean_evictions > 0)
+    printf("%s:          %lu page-ins, %lu page-outs, %lu clean evictions, %lu executed instructions of simulated swap I/O\n", selfie_name,
+           page_ins,
+           page_outs,
+           clean_evictions,
+           (page_ins + page_outs) * SWAPIOCOST);
+  if (mapped_superpages > 0)
+    printf("%s:          %lu.%.2luMB mapped in %lu superpages\n", selfie_name,
+           ratio_format_integral_2(mapped_superpages * SUPERPAGESIZE, MEGABYTE),
+           ratio_format_fractional_2(mapped_superpages * SUPERPAGESIZE, MEGABYTE),
+           mapped_superpages);
+  if (faultaround_pages > 0)
+    printf("%s:          up to %lu page faults avoided by mapping pages around faults\n", selfie_name,
+           faultaround_pages);
+  if (uploaded_pages > content_pages)
+    printf("%s:          %lu code and data pages uploaded into %lu shared frames\n", selfie_name,
+           uploaded_pages,
+           content_pages);
+  if (merged_pages > 0)
+    printf("%s:          %lu pages merged in %lu scans for identical pages, freeing %lu.%.2luMB in %lu frames\n", selfie_name,
+           merged_pages,
+           ksm_scans,
+           ratio_format_integral_2(saved_frames * PAGESIZE, MEGABYTE),
+           ratio_format_fractional_2(saved_frames * PAGESIZE, MEGABYTE),
+           saved_frames);
+  if (binary_pages > 0)
+    printf("%s:          %lu code and data pages mapped from loaded binary without copying\n", selfie_name,
+           binary_pages);
+  if (synced_PTEs > 0)
+    printf("%s:          %lu page table entries of hosted contexts synchronized, %lu by rescanning regions\n", selfie_name,
+           synced_PTEs,
+           rescanned_PTEs);
+
+  // scheduling metrics in charged instructions since context creation
+  completed  = 0;
+  turnaround = 0;
+  response   = 0;
+  responses  = 0;
+
+  context = used_contexts;
+
+  while (context != (uint64_t *)0)
+  {
+    if (get_completion(context) != UINT64_MAX)
+    {
+      completed  = completed + 1;
+      turnaround = turnaround + get_completion(context) - get_arrival(context);
+      response   = response + get_io_response(context);
+      responses  = responses + get_io_responses(context);
+    }
+
+    context = get_next_context(context);
+  }
+
+  if (completed > 1)
+    printf("%s:          %lu exited contexts with %lu instructions average turnaround\n", selfie_name,
+           completed,
+           turnaround / completed);
+  if (responses > 0)
+    printf("%s:          %lu writes with %lu instructions average response to I/O\n", selfie_name,
+           responses,
+           response / responses);
+
+  down_load_profiles();
+
+  context = used_contexts;
+
+  while (context != (uint64_t *)0)
+  {
+    printf("%s: ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n", selfie_name);
+    printf("%s: context: %s\n", selfie_name, get_name(context));
+    if (get_ic_all(context) > 0)
+    {
+      print_instruction_versus_exception_profile(context);
+      printf("%s:          %lu.%.2luKB peak stack size\n", selfie_name,
+             ratio_format_integral_2(VIRTUALMEMORYSIZE * GIGABYTE - get_mc_stack_peak(context), KILOBYTE),
+             ratio_format_fractional_2(VIRTUALMEMORYSIZE * GIGABYTE - get_mc_stack_peak(context), KILOBYTE));
+      printf("%s:          %lu.%.2luMB allocated in %lu mallocs (%lu.%.2luMB or %lu.%.2lu%% actually accessed)\n", selfie_name,
+             ratio_format_integral_2(get_program_break(context) - get_heap_seg_start(context), MEGABYTE),
+             ratio_format_fractional_2(get_program_break(context) - get_heap_seg_start(context), MEGABYTE),
+             get_lc_malloc(context),
+             ratio_format_integral_2(get_mc_mapped_heap(context), MEGABYTE),
+             ratio_format_fractional_2(get_mc_mapped_heap(context), MEGABYTE),
+             percentage_format_integral_2(round_up(get_program_break(context) - get_heap_seg_start(context), PAGESIZE),
+                                          get_mc_mapped_heap(context)),
+             percentage_format_fractional_2(round_up(get_program_break(context) - get_heap_seg_start(context), PAGESIZE),
+                                            get_mc_mapped_heap(context)));
+    }
+    if (get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context) > 0)
+    {
+      printf("%s:          %lu exceptions handled by ", selfie_name,
+             get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context));
+      if (get_parent(context) == MY_CONTEXT)
+        printf("%s", selfie_name);
+      else
+        printf("%s", get_name(get_parent(context)));
+      if (get_ic_all(context) > 0)
+        printf(", one every %lu executed instructions",
+               ratio_format_integral_2(get_ic_all(context),
+                                       get_ec_syscall(context) + get_ec_page_fault(context) + get_ec_timer(context)));
+      println();
+      printf("%s:          %lu syscalls, %lu page faults, %lu timer interrupts\n", selfie_name,
+             get_ec_syscall(context),
+             get_ec_page_fault(context),
+             get_ec_timer(context));
+    }
+    if (get_completion(context) != UINT64_MAX)
+      printf("%s:          %lu instructions turnaround\n", selfie_name,
+             get_completion(context) - get_arrival(context));
+    if (get_io_responses(context) > 0)
+      printf("%s:          %lu writes with %lu instructions average response to I/O\n", selfie_name,
+             get_io_responses(context),
+             get_io_response(context) / get_io_responses(context));
+    if (scheduler_type == SCHEDULER_STRIDE)
+      if (get_parent(context) == MY_CONTEXT)
+        printf("%s:          %lu tickets, %lu instructions on CPU [%lu.%.2lu%% of %lu charged instructions]\n", selfie_name,
+               get_tickets(context),
+               get_cpu_time(context),
+               percentage_format_integral_2(charged_instructions, get_cpu_time(context)),
+               percentage_format_fractional_2(charged_instructions, get_cpu_time(context)),
+               charged_instructions);
+
+    context = get_next_context(context);
+  }
+
+  if (GC_ON)
+  {
+    printf("%s: ++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++\n", selfie_name);
+    print_gc_profile(1);
+  }
+
+  if (get_total_number_of_instructions() > 0)
+  {
+    print_instruction_counters();
+
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    if (code_line_number != (uint64_t *)0)
+      printf("%s: profile: total,max(ratio%%)@address(line#),2ndmax,3rdmax\n", selfie_name);
+    else
+      printf("%s: profile: total,max(ratio%%)@address,2ndmax,3rdmax\n", selfie_name);
+    print_per_instruction_profile("calls:   ", calls, calls_per_procedure);
+    print_per_instruction_profile("loops:   ", iterations, iterations_per_loop);
+    print_per_instruction_profile("loads:   ", ic_load, loads_per_instruction);
+    print_per_instruction_profile("stores:  ", ic_store, stores_per_instruction);
+
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    print_register_memory_profile();
+  }
+
+  if (L1_CACHE_ENABLED)
+  {
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    printf("%s: L1 caches:     accesses,hits,misses\n", selfie_name);
+
+    print_cache_profile(get_cache_hits(L1_DCACHE), get_cache_misses(L1_DCACHE), "data:          ");
+    println();
+
+    print_cache_profile(get_cache_hits(L1_ICACHE), get_cache_misses(L1_ICACHE), "instruction:   ");
+    if (L1_CACHE_COHERENCY)
+      printf(" (coherency invalidations: %lu)", L1_icache_coherency_invalidations);
+    println();
+  }
+
+  if (tlb_hits + tlb_misses > 0)
+  {
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    printf("%s: TLB:           accesses,hits,misses\n", selfie_name);
+
+    print_cache_profile(tlb_hits, tlb_misses, "translations:  ");
+    println();
+  }
+
+  if (basic_blocks)
+  {
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    printf("%s: basic blocks:  %lu translated, %lu hot traces, %lu executed, %lu chained", selfie_name,
+           translated_blocks,
+           hot_traces,
+           executed_blocks,
+           chained_blocks);
+    if (executed_blocks > 0)
+      printf(", %lu.%.2lu instructions per block",
+             ratio_format_integral_2(get_total_number_of_instructions(), executed_blocks),
+             ratio_format_fractional_2(get_total_number_of_instructions(), executed_blocks));
+    println();
+    printf("%s: fused:         %lu ld+addi, %lu lui+addi, %lu addi+sd superinstructions\n", selfie_name,
+           fused_pops,
+           fused_constants,
+           fused_pushes);
+
+    printf("%s: --------------------------------------------------------------------------------\n", selfie_name);
+    printf("%s: n-grams:       total,max(ratio%%)@mnemonics,2ndmax,3rdmax,4thmax,5thmax\n", selfie_name);
+    print_ngram_profile("pairs:         ", 2);
+    print_ngram_profile("triples:       ", 3);
+  }
+}
+
+void print_ngram_profile(char *message, uint64_t n)
+{
+  uint64_t size;
+  uint64_t *counters;
+  uint64_t *block;
+  uint64_t i;
+  uint64_t j;
+  uint64_t key;
+  uint64_t total;
+  uint64_t max;
+  uint64_t reported;
+
+  // counts how often each sequence of n instructions executed within
+  // translated blocks as candidates for further superinstructions
+
+  size = 1;
+  i = 0;
+
+  while (i < n)
+  {
+    size = size * NGRAMOPCODES;
+
+    i = i + 1;
+  }
+
+  counters = zmalloc(size * sizeof(uint64_t));
+
+  total = 0;
+
+  block = translated_block_list;
+
+  while (block != (uint64_t *)0)
+  {
+    i = 0;
+
+    while (i + n <= get_block_length(block))
+    {
+      key = 0;
+      j = 0;
+
+      while (j < n)
+      {
+        key = key * NGRAMOPCODES + *get_block_instruction(block, i + j);
+
+        j = j + 1;
+      }
+
+      *(counters + key) = *(counters + key) + get_block_executions(block);
+
+      total = total + get_block_executions(block);
+
+      i = i + 1;
+    }
+
+    block = get_block_next(block);
+  }
+
+  printf("%s: %s%lu", selfie_name, message, total);
+
+  reported = 0;
+
+  while (reported < NGRAMSREPORTED)
+  {
+    max = 0;
+    key = 0;
+    i = 0;
+
+    while (i < size)
+    {
+      if (*(counters + i) > max)
+      {
+        max = *(counters + i);
+        key = i;
+      }
+
+      i = i + 1;
+    }
+
+    if (max > 0)
+    {
+      // CAUTION: we reset counter to avoid reporting it again
+      *(counters + key) = 0;
+
+      printf(",%lu(%lu.%.2lu%%)@", max,
+             percentage_format_integral_2(total, max),
+             percentage_format_fractional_2(total, max));
+
+      // most significant opcode is first instruction
+      j = size / NGRAMOPCODES;
+
+      while (j > 0)
+      {
+        printf("%s", get_mnemonic(key / j % NGRAMOPCODES));
+
+        j = j / NGRAMOPCODES;
+
+        if (j > 0)
+          printf("+");
+      }
+    }
+    else
+      printf(",0(0.00%%)");
+
+    reported = reported + 1;
+  }
+
+  println();
+}
+
+void print_host_os()
+{
+  if (OS == SELFIE)
+    printf("selfie");
+  else if (OS == LINUX)
+    printf("Linux");
+  else if (OS == MACOS)
+    printf("macOS");
+  else if (OS == WINDOWS)
+    printf("Windows");
+  else if (OS == BAREMETAL)
+    printf("bare metal");
+  else
+    printf("unknown");
+}
+
+// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+// -----------------------------------------------------------------
+// ----------------------    R U N T I M E    ----------------------
+// -----------------------------------------------------------------
+// *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~ *~*~
+
+// -----------------------------------------------------------------
+// ------------------------ MACHINE CONTEXTS -----------------------
+// -----------------------------------------------------------------
+
+uint64_t *new_context()
+{
+  uint64_t *context;
+
+  if (free_contexts == (uint64_t *)0)
+    context = allocate_context();
+  else
+  {
+    context = free_contexts;
+
+    free_contexts = get_next_context(free_contexts);
+  }
+
+  set_next_context(context, used_contexts);
+  set_prev_context(context, (uint64_t *)0);
+
+  if (used_contexts != (uint64_t *)0)
+    set_prev_context(used_contexts, context);
+
+  used_contexts = context;
+
+  return context;
+}
+
+void init_context(uint64_t *context, uint64_t *parent, uint64_t *vctxt)
+{
+  char *context_name;
+
+  // some fields are set in boot loader or when context switching
+
+  // allocate zeroed memory for general-purpose registers
+  // TODO: reuse memory
+  set_regs(context, zmalloc(NUMBEROFREGISTERS * sizeof(uint64_t)));
+
+  // allocate zeroed memory for page table
+  // TODO: save and reuse memory for page table
+  if (PAGETABLETREE == 0)
+    // for a 4GB-virtual-memory page table with
+    // 4KB pages and 64-bit pointers, allocate
+    // 8MB = 2^23 ((2^32 / 2^12) * 2^3) bytes to
+    // accommodate 2^20 (2^32 / 2^12) PTEs
+    set_pt(context, zmalloc(NUMBEROFPAGES * sizeof(uint64_t *)));
+  else
+    // for the root node (page directory) of a two-level
+    // page table, allocate 16KB = 2^14 (2^32 / 2^12 / 2^9 * 2^3)
+    // bytes to accommodate 2^11 ((2^32 / 2^12) / 2^9) root PDEs
+    // pointing to 4KB leaf nodes (page tables) that
+    // each accommodate 2^9 (2^12 / 2^3) leaf PTEs;
+    // in a three-level page table, 4 root PDEs point to
+    // 4KB mid nodes with 2^9 PDEs pointing to leaf nodes
+    // or 2MB superpages
+    set_pt(context, zmalloc(get_number_of_root_PDEs() * sizeof(uint64_t *)));
+
+  // page table memory may have been used by a previous context
+  flush_tlb();
+
+  // instructions are decoded on first execution
+  set_decoded_code(context, (uint64_t *)0);
+  set_basic_blocks(context, (uint64_t *)0);
+
+  // reset page table cache
+  set_lowest_lo_page(context, 0);
+  set_highest_lo_page(context, get_lowest_lo_page(context));
+  set_lowest_hi_page(context, get_page_of_virtual_address(HIGHESTVIRTUALADDRESS));
+  set_highest_hi_page(context, get_lowest_hi_page(context));
+
+  // TODO: reuse memory
+  set_PTE_log(context, smalloc(PTELOGSIZE * sizeof(uint64_t)));
+  set_PTE_log_length(context, 0);
+
+  if (parent != MY_CONTEXT)
+  {// Si parent no es el kernel
+    set_code_seg_start(context, load_virtual_memory(get_pt(parent), code_seg_start(vctxt)));
+    set_code_seg_size(context, load_virtual_memory(get_pt(parent), code_seg_size(vctxt)));
+    set_data_seg_start(context, load_virtual_memory(get_pt(parent), data_seg_start(vctxt)));
+    set_data_seg_size(context, load_virtual_memory(get_pt(parent), data_seg_size(vctxt)));
+    set_heap_seg_start(context, load_virtual_memory(get_pt(parent), heap_seg_start(vctxt)));
+
+    context_name = string_alloc(MAX_FILENAME_LENGTH);
+
+    down_load_string(parent, load_virtual_memory(get_pt(parent), name(vctxt)), context_name);
+
+    set_name(context, context_name);
+  }
+  else
+  { // Si parent es el kernel
+    set_exception(context, EXCEPTION_NOEXCEPTION);
+    set_fault(context, 0);
+
+    set_exit_code(context, EXITCODE_NOERROR);
+  }
+
+  set_parent(context, parent);
+  set_virtual_context(context, vctxt);
+
+  // profile
+  set_ic_all(context, 0);
+  set_lc_malloc(context, 0);
+  set_ec_syscall(context, 0);
+  set_ec_page_fault(context, 0);
+  set_ec_timer(context, 0);
+  set_mc_stack_peak(context, HIGHESTVIRTUALADDRESS);
+  set_mc_mapped_heap(context, 0);
+
+  // garbage collector
+  set_used_list_head(context, (uint64_t *)0);
+  set_free_list_head(context, (uint64_t *)0);
+  set_gcs_in_period(context, 0);
+  set_use_gc_kernel(context, GC_DISABLED);
+
+  //New Settings
+  set_id_context(context, id_ctxt_counter); // fork
+  id_ctxt_counter = id_ctxt_counter + 1;
+
+  set_ptr_parent_ctx(context, (uint64_t *)0); // fork: seteamos el parent_context a null
+  set_vruntime(context, 0); // CFS: inicializar vruntime a 0
+
+  set_blocked(context, 0); // semaphores
+  set_rq_color(context, 0); // not in run queue yet
+
+  set_nice(context, 0);
+  set_weight(context, NICE0WEIGHT);
+  set_runtime(context, 0);
+
+  set_level(context, 0);
+  set_level_boosts(context, mlfq_boosts);
+  set_next_in_level(context, (uint64_t *)0);
+  set_prev_in_level(context, (uint64_t *)0);
+
+  set_arrival(context, charged_instructions);
+  set_io_ready(context, UINT64_MAX);
+  set_completion(context, UINT64_MAX);
+
+  // new contexts join at the current global pass
+  set_tickets(context, DEFAULTTICKETS);
+  set_pass(context, global_pass);
+  set_cpu_time(context, 0);
+
+  set_next_in_state(context, (uint64_t *)0);
+  set_prev_in_state(context, (uint64_t *)0);
+  set_wait_kind(context, 0);
+  set_wait_address(context, 0);
+
+  set_io_response(context, 0);
+  set_io_responses(context, 0);
+}
+
+uint64_t *get_vctxt_bucket(uint64_t *vctxt)
+{
+  // virtual contexts are CONTEXTENTRIES words apart in guest memory
+  return contexts_by_vctxt + (uint64_t)vctxt / sizeof(uint64_t) % CONTEXTBUCKETS;
+}
+
+uint64_t *get_id_bucket(uint64_t id)
+{
+  return contexts_by_id + id % CONTEXTBUCKETS;
+}
+
+void index_context(uint64_t *context)
+{
+  uint64_t *bucket;
+
+  if (contexts_by_id == (uint64_t *)0)
+  {
+    contexts_by_vctxt = zmalloc(CONTEXTBUCKETS * sizeof(uint64_t *));
+    contexts_by_id    = zmalloc(CONTEXTBUCKETS * sizeof(uint64_t *));
+  }
+
+  // contexts created on my boot level have no virtual context
+  if (get_virtual_context(context) != (uint64_t *)0)
+  {
+    bucket = get_vctxt_bucket(get_virtual_context(context));
+
+    set_next_by_vctxt(context, (uint64_t *)*bucket);
+
+    *bucket = (uint64_t)context;
+  }
+
+  bucket = get_id_bucket(get_id_context(context));
+
+  set_next_by_id(context, (uint64_t *)*bucket);
+
+  *bucket = (uint64_t)context;
+}
+
+void unindex_context(uint64_t *context)
+{
+  uint64_t *bucket;
+  uint64_t *previous;
+  uint64_t *entry;
+
+  if (get_virtual_context(context) != (uint64_t *)0)
+  {
+    bucket = get_vctxt_bucket(get_virtual_context(context));
+
+    previous = (uint64_t *)0;
+
+    entry = (uint64_t *)*bucket;
+
+    while (entry != context)
+    {
+      previous = entry;
+
+      entry = get_next_by_vctxt(entry);
+    }
+
+    if (previous == (uint64_t *)0)
+      *bucket = (uint64_t)get_next_by_vctxt(context);
+    else
+      set_next_by_vctxt(previous, get_next_by_vctxt(context));
+  }
+
+  bucket = get_id_bucket(get_id_context(context));
+
+  previous = (uint64_t *)0;
+
+  entry = (uint64_t *)*bucket;
+
+  while (entry != context)
+  {
+    previous = entry;
+
+    entry = get_next_by_id(entry);
+  }
+
+  if (previous == (uint64_t *)0)
+    *bucket = (uint64_t)get_next_by_id(context);
+  else
+    set_next_by_id(previous, get_next_by_id(context));
+}
+
+uint64_t *find_context(uint64_t *parent, uint64_t *vctxt)
+{
+  uint64_t *context;
+
+  if (contexts_by_vctxt == (uint64_t *)0)
+    return (uint64_t *)0;
+
+  context = (uint64_t *)*get_vctxt_bucket(vctxt);
+
+  while (context != (uint64_t *)0)
+  {
+    if (get_parent(context) == parent)
+      if (get_virtual_context(context) == vctxt)
+        return context;
+
+    context = get_next_by_vctxt(context);
+  }
+
+  return (uint64_t *)0;
+}
+
+uint64_t *find_context_by_id (uint64_t id) {// Semaphores
+	uint64_t *cur;
+
+	if (contexts_by_id == (uint64_t *) 0)
+		return (uint64_t *) 0;
+
+	cur = (uint64_t *) *get_id_bucket(id);
+	while (cur != (uint64_t *) 0) {
+		if (get_id_context (cur) == id){
+			return cur;
+		}
+
+		cur = get_next_by_id(cur);
+	}
+
+	return (uint64_t *) 0;
+}
+
+void free_context(uint64_t *context)
+{
+  set_next_context(context, free_contexts);
+
+  free_contexts = context;
+}
+
+uint64_t *delete_context(uint64_t *context, uint64_t *from)
+{
+  if (get_next_context(context) != (uint64_t *)0)
+    set_prev_context(get_next_context(context), get_prev_context(context));
+
+  if (get_prev_context(context) != (uint64_t *)0)
+  {
+    set_next_context(get_prev_context(context), get_next_context(context));
+    set_prev_context(context, (uint64_t *)0);
+  }
+  else
+    from = get_next_context(context);
+
+  unindex_context(context);
+
+  dequeue_context(context);
+  remove_from_state_queue(context);
+
+  reclaim_frames(context);
+
+  free_context(context);
+
+  return from;
+}
+
+// -----------------------------------------------------------------
+// -------------------------- MICROKERNEL --------------------------
+// -----------------------------------------------------------------
+
+uint64_t *create_context(uint64_t *parent, uint64_t *vctxt)
+{
+  uint64_t *context;
+
+  context = new_context();
+
+  init_context(context, parent, vctxt);
+
+  index_context(context);
+
+  // contexts hosted by a guest kernel are scheduled by their parent
+  if (parent == MY_CONTEXT)
+    enqueue_context(context);
+
+  // Initialize lockdep fields
+  set_held_locks_head(context, (uint64_t *)0);
+  set_held_locks_count(context, 0);
+
+  if (debug_create)
+    printf("%s: parent context %s created child context %s\n", selfie_name,
+           get_name(parent), get_name(used_contexts));
+
+  return context;
+}
+
+uint64_t *cache_context(uint64_t *vctxt)
+{
+  uint64_t *context;
+
+  // find cached context on my boot level
+  context = find_context(current_context, vctxt);
+
+  if (context == (uint64_t *)0)
+    // create cached context on my boot level
+    context = create_context(current_context, vctxt);
+
+  return context;
+}
+
+void save_context(uint64_t *context)
+{
+  uint64_t *parent_table;
+  uint64_t *vctxt;
+  uint64_t r;
+  uint64_t *pregs;
+  uint64_t *vregs;
+
+  // save machine state
+  set_pc(context, pc);
+
+  if (get_parent(context) != MY_CONTEXT)
+  {
+    // upload changes in context to virtual context in parent address space
+    parent_table = get_pt(get_parent(context));
+
+    vctxt = get_virtual_context(context);
+
+    store_virtual_memory(parent_table, program_counter(vctxt), get_pc(context));
+
+    r = 0;
+
+    pregs = get_regs(context);
+    vregs = (uint64_t *)load_virtual_memory(parent_table, regs(vctxt));
+
+    while (r < NUMBEROFREGISTERS)
+    {
+      store_virtual_memory(parent_table, (uint64_t)(vregs + r), *(pregs + r));
+
+      r = r + 1;
+    }
+
+    store_virtual_memory(parent_table, program_break(vctxt), get_program_break(context));
+
+    store_virtual_memory(parent_table, exception(vctxt), get_exception(context));
+    store_virtual_memory(parent_table, fault(vctxt), get_fault(context));
+    store_virtual_memory(parent_table, exit_code(vctxt), get_exit_code(context));
+
+    // garbage collector state (only necessary if context is gced by different gcs)
+
+    store_virtual_memory(parent_table, used_list_head(vctxt), (uint64_t)get_used_list_head(context));
+    store_virtual_memory(parent_table, free_list_head(vctxt), (uint64_t)get_free_list_head(context));
+    store_virtual_memory(parent_table, gcs_in_period(vctxt), get_gcs_in_period(context));
+    store_virtual_memory(parent_table, use_gc_kernel(vctxt), get_use_gc_kernel(context));
+  }
+
+  set_ic_all(context, get_total_number_of_instructions() - get_ic_all(context));
+
+  if (*(get_regs(context) + REG_SP) < get_mc_stack_peak(context))
+    // keep track of peak amount of stack allocation
+    set_mc_stack_peak(context, *(get_regs(context) + REG_SP));
+}
+
+uint64_t create_semaphore (uint64_t value) { // Semaphores
+	uint64_t *sem;
+	uint64_t sem_id;
+  uint64_t i;
+
+	sem_id = next_sem_id;
+	next_sem_id = next_sem_id + 1;
+	sem = used_semaphores + (sem_id * SEMAPHOREENTRIES);
+
+	set_sem_value (sem, value);
+	set_sem_n_waiters (sem, 0);
+	set_sem_waiters (sem, smalloc (sizeof (uint64_t) * 64)); // At most 64 waiters
+
+	i = 0;
+	while (i < 64) {
+      *(get_sem_waiters (sem) + i) = -1;
+	  i = i + 1;
+	}
+
+	return sem_id;
+}
+
+uint64_t create_lock() { // Locks
+	uint64_t *lock;
+	uint64_t lock_id;
+	uint64_t sem_id;
+
+	lock_id = next_lock_id;
+	next_lock_id = next_lock_id + 1;
+	lock = used_locks + (lock_id * LOCKENTRIES);
+
+	// Creamos un semáforo binario inicializado en 1
+	sem_id = create_semaphore(1);
+	set_lock_semaphore(lock, sem_id);
+	set_lock_owner(lock, -1); // Sin propietario al inicio
+
+	return lock_id;
+}
+
+uint64_t lowest_page(uint64_t page, uint64_t lo)
+{
+  if (page < lo)
+    return page;
+  else
+    return lo;
+}
+
+uint64_t highest_page(uint64_t page, uint64_t hi)
+{
+  if (page >= hi)
+    // only lo <= page < hi will be cached
+    return page + 1;
+  else
+    return hi;
+}
+
+void log_page_update(uint64_t *context, uint64_t page)
+{
+  uint64_t length;
+
+  // a hypster hosting context only synchronizes logged pages
+  length = get_PTE_log_length(context);
+
+  if (length < PTELOGSIZE)
+    *(get_PTE_log(context) + length) = page;
+
+  if (length <= PTELOGSIZE)
+    set_PTE_log_length(context, length + 1);
+
+  // exploit spatial locality in page table caching
+  if (page <= get_page_of_virtual_address(get_program_break(context) - WORDSIZE))
+  {
+    set_lowest_lo_page(context, lowest_page(page, get_lowest_lo_page(context)));
+    set_highest_lo_page(context, highest_page(page, get_highest_lo_page(context)));
+  }
+  else
+  {
+    set_lowest_hi_page(context, lowest_page(page, get_lowest_hi_page(context)));
+    set_highest_hi_page(context, highest_page(page, get_highest_hi_page(context)));
+  }
+}
+
+void map_page(uint64_t *context, uint64_t page, uint64_t frame)
+{
+  uint64_t *table;
+
+  if (frame != 0)
+  {
+    table = get_pt(context);
+
+    if (get_frame_for_page(table, page) != 0)
+      // remapping keeps accessed, dirty, and tracked bits
+      frame = frame + get_PTE_usage_bits(get_PTE_for_page(table, page));
+
+    // map unmapped page or remap page to different frame or flags
+    if (get_PTE_for_page(table, page) != frame)
+    {
+      set_PTE_for_page(table, page, frame);
+
+      invalidate_tlb_page(table, page);
+
+      log_page_update(context, page);
+    }
+  }
+
+  if (debug_map)
+    printf("%s: page 0x%04lX mapped to frame 0x%08lX in context %s\n", selfie_name,
+           page, (uint64_t)frame, get_name(context));
+}
+
+void restore_page(uint64_t *context, uint64_t *table, uint64_t *parent_table, uint64_t page)
+{
+  uint64_t frame;
+
+  frame = load_PTE_for_page(parent_table, table, page);
+
+  if (frame == 0)
+    frame = PTE_SWAPPED;
+
+  if (has_PTE_flag(frame, PTE_SWAPPED) == 0)
+    // keep read-only flag of guest page table entry
+    map_page(context, page, get_frame_for_page(parent_table, get_page_of_virtual_address(frame))
+      + has_PTE_flag(frame, PTE_READONLY) * PTE_READONLY);
+  else if (is_page_mapped(get_pt(context), page))
+  {
+    // pages unmapped or swapped out by guest are unmapped
+    set_PTE_for_page(get_pt(context), page, 0);
+
+    invalidate_tlb_page(get_pt(context), page);
+  }
+
+  synced_PTEs = synced_PTEs + 1;
+}
+
+void restore_region(uint64_t *context, uint64_t *table, uint64_t *parent_table, uint64_t lo, uint64_t hi)
+{
+  while (lo < hi)
+  {
+    restore_page(context, table, parent_table, lo);
+
+    rescanned_PTEs = rescanned_PTEs + 1;
+
+    lo = lo + 1;
+  }
+}
+
+void restore_context(uint64_t *context)
+{
+  uint64_t *parent_table;
+  uint64_t *vctxt;
+  uint64_t r;
+  uint64_t *pregs;
+  uint64_t *vregs;
+  uint64_t *table;
+  uint64_t length;
+  uint64_t *log;
+  uint64_t lo;
+  uint64_t hi;
+
+  if (get_parent(context) != MY_CONTEXT)
+  {
+    // download changes in virtual context in parent address space to context
+    parent_table = get_pt(get_parent(context));
+
+    vctxt = get_virtual_context(context);
+
+    set_pc(context, load_virtual_memory(parent_table, program_counter(vctxt)));
+
+    r = 0;
+
+    pregs = get_regs(context);
+    vregs = (uint64_t *)load_virtual_memory(parent_table, regs(vctxt));
+
+    while (r < NUMBEROFREGISTERS)
+    {
+      *(pregs + r) = load_virtual_memory(parent_table, (uint64_t)(vregs + r));
+
+      r = r + 1;
+    }
+
+    set_program_break(context, load_virtual_memory(parent_table, program_break(vctxt)));
+
+    set_exception(context, load_virtual_memory(parent_table, exception(vctxt)));
+    set_fault(context, load_virtual_memory(parent_table, fault(vctxt)));
+
+    set_exit_code(context, load_virtual_memory(parent_table, exit_code(vctxt)));
+
+    table = (uint64_t *)load_virtual_memory(parent_table, page_table(vctxt));
+
+    // page table of context shadows guest page table and is only
+    // synchronized with guest page table entries updated since last restore
+
+    length = load_virtual_memory(parent_table, PTE_log_length(vctxt));
+
+    if (length <= PTELOGSIZE)
+    {
+      log = (uint64_t *)load_virtual_memory(parent_table, PTE_log(vctxt));
+
+      r = 0;
+
+      while (r < length)
+      {
+        restore_page(context, table, parent_table, load_virtual_memory(parent_table, (uint64_t)(log + r)));
+
+        r = r + 1;
+      }
+    }
+    else
+    {
+      // assert: virtual context page table is only mapped from beginning up and end down
+
+      lo = load_virtual_memory(parent_table, lowest_lo_page(vctxt));
+      hi = load_virtual_memory(parent_table, highest_lo_page(vctxt));
+
+      restore_region(context, table, parent_table, lo, hi);
+
+      lo = load_virtual_memory(parent_table, lowest_hi_page(vctxt));
+      hi = load_virtual_memory(parent_table, highest_hi_page(vctxt));
+
+      restore_region(context, table, parent_table, lo, hi);
+    }
+
+    store_virtual_memory(parent_table, PTE_log_length(vctxt), 0);
+
+    // empty page table cache regions
+    store_virtual_memory(parent_table, lowest_lo_page(vctxt), load_virtual_memory(parent_table, highest_lo_page(vctxt)));
+    store_virtual_memory(parent_table, highest_hi_page(vctxt), load_virtual_memory(parent_table, lowest_hi_page(vctxt)));
+
+    // garbage collector state (only necessary if context is gced by different gcs)
+
+    set_used_list_head(context, (uint64_t *)load_virtual_memory(parent_table, used_list_head(vctxt)));
+    set_free_list_head(context, (uint64_t *)load_virtual_memory(parent_table, free_list_head(vctxt)));
+    set_gcs_in_period(context, load_virtual_memory(parent_table, gcs_in_period(vctxt)));
+    set_use_gc_kernel(context, load_virtual_memory(parent_table, use_gc_kernel(vctxt)));
+  }
+
+  // restore machine state
+  pc = get_pc(context);
+  registers = get_regs(context);
+  pt = get_pt(context);
+
+  if (get_decoded_code(context) == (uint64_t *)0)
+    // code segment is decoded lazily on first execution of each instruction
+    set_decoded_code(context, zmalloc(get_code_seg_size(context) / INSTRUCTIONSIZE * DECODEDENTRIES * sizeof(uint64_t)));
+
+  decoded_code = get_decoded_code(context);
+
+  flush_all_caches();
+
+  flush_tlb();
+
+  set_ic_all(context, get_total_number_of_instructions() - get_ic_all(context));
+
+  // printf("DEBUG regs: gp=0x%lx sp=0x%lx ra=0x%lx pc=0x%lx\n",
+  //      *(registers+REG_GP), *(registers+REG_SP), *(registers+REG_RA), *(registers+REG_A6));
+
+}
+
+uint64_t is_code_address(uint64_t *context, uint64_t vaddr)
+{
+  // is address in code segment?
+  if (vaddr >= get_code_seg_start(context))
+    if (vaddr < get_code_seg_start(context) + get_code_seg_size(context))
+      return 1;
+
+  return 0;
+}
+
+uint64_t is_data_address(uint64_t *context, uint64_t vaddr)
+{
+  // is address in data segment?
+  if (vaddr >= get_data_seg_start(context))
+    if (vaddr < get_data_seg_start(context) + get_data_seg_size(context))
+      return 1;
+
+  return 0;
+}
+
+uint64_t is_stack_address(uint64_t *context, uint64_t vaddr)
+{
+  // is address in stack segment?
+  if (vaddr >= *(get_regs(context) + REG_SP))
+    if (vaddr <= HIGHESTVIRTUALADDRESS)
+      return 1;
+
+  return 0;
+}
+
+uint64_t is_heap_address(uint64_t *context, uint64_t vaddr)
+{
+  // is address in heap segment?
+  if (vaddr >= get_heap_seg_start(context))
+    if (vaddr < get_program_break(context))
+      return 1;
+
+  return 0;
+}
+
+uint64_t is_address_between_stack_and_heap(uint64_t *context, uint64_t vaddr)
+{
+  // is address between heap and stack segments?
+  if (vaddr >= get_program_break(context))
+    if (vaddr < *(get_regs(context) + REG_SP))
+      return 1;
+
+  return 0;
+}
+
+uint64_t is_data_stack_heap_address(uint64_t *context, uint64_t vaddr)
+{
+  if (is_data_address(context, vaddr))
+    return 1;
+  else if (is_stack_address(context, vaddr))
+    return 1;
+  else if (is_heap_address(context, vaddr))
+    return 1;
+  else
+    return 0;
+}
+
+uint64_t is_data_stack_heap_region(uint64_t *context, uint64_t vaddr, uint64_t last)
+{
+  // are both addresses in the same segment and thus all in between?
+  if (is_data_address(context, vaddr))
+    return is_data_address(context, last);
+  else if (is_stack_address(context, vaddr))
+    return is_stack_address(context, last);
+  else if (is_heap_address(context, vaddr))
+    return is_heap_address(context, last);
+  else
+    return 0;
+}
+
+uint64_t is_valid_segment_read(uint64_t vaddr)
+{
+  if (is_data_address(current_context, vaddr))
+  {
+    data_reads = data_reads + 1;
+
+    return 1;
+  }
+  else if (is_stack_address(current_context, vaddr))
+  {
+    stack_reads = stack_reads + 1;
+
+    return 1;
+  }
+  else if (is_heap_address(current_context, vaddr))
+  {
+    heap_reads = heap_reads + 1;
+
+    return 1;
+  }
+  else
+    return 0;
+}
+
+uint64_t is_valid_segment_write(uint64_t vaddr)
+{
+  if (is_data_address(current_context, vaddr))
+  {
+    data_writes = data_writes + 1;
+
+    return 1;
+  }
+  else if (is_stack_address(current_context, vaddr))
+  {
+    stack_writes = stack_writes + 1;
+
+    return 1;
+  }
+  else if (is_heap_address(current_context, vaddr))
+  {
+    heap_writes = heap_writes + 1;
+
+    return 1;
+  }
+  else
+    return 0;
+}
+
+// -----------------------------------------------------------------
+// ---------------------------- KERNEL -----------------------------
+// -----------------------------------------------------------------
+
+uint64_t pavailable()
+{
+  if (free_frames != (uint64_t *)0)
+    return 1;
+  else if (free_page_frame_memory > 0)
+    return 1;
+  else if (allocated_page_frame_memory + MEGABYTE <=
+           PHYSICALMEMORYEXCESS * PHYSICALMEMORYSIZE * sizeof(uint64_t) / WORDSIZE)
+    // single word on 32-bit target occupies double word on 64-bit system
+    return 1;
+  else
+    return 0;
+}
+
+uint64_t pused()
+{
+  return allocated_page_frame_memory - free_page_frame_memory - reclaimed_page_frame_memory;
+}
+
+uint64_t *palloc()
+{
+  uint64_t double_for_single_word;
+  uint64_t block;
+  uint64_t frame;
+  uint64_t i;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  double_for_single_word = sizeof(uint64_t) / WORDSIZE;
+
+  if (free_frames != (uint64_t *)0)
+  {
+    // reuse reclaimed page frame
+    frame = (uint64_t)free_frames;
+
+    free_frames = (uint64_t *)*free_frames;
+
+    reclaimed_page_frame_memory = reclaimed_page_frame_memory - PAGESIZE * double_for_single_word;
+
+    i = 0;
+
+    // reclaimed page frames are zeroed like freshly allocated ones
+    while (i < PAGESIZE / WORDSIZE)
+    {
+      *((uint64_t *)frame + i) = 0;
+
+      i = i + 1;
+    }
+
+    return (uint64_t *)frame;
+  }
+
+  // assert: PHYSICALMEMORYSIZE is equal to or a multiple of MEGABYTE
+  // assert: PAGESIZE is a factor of MEGABYTE strictly less than MEGABYTE
+
+  if (free_page_frame_memory == 0)
+  {
+    if (pavailable())
+    {
+      free_page_frame_memory = MEGABYTE * double_for_single_word;
+
+      // on boot level 0 allocate zeroed memory
+      block = (uint64_t)zmalloc(free_page_frame_memory);
+
+      allocated_page_frame_memory = allocated_page_frame_memory + free_page_frame_memory;
+
+      // page frames must be page-aligned to work as page table index
+      next_page_frame = round_up(block, PAGESIZE * double_for_single_word);
+
+      if (next_page_frame > block)
+        // losing one page frame to fragmentation
+        free_page_frame_memory = free_page_frame_memory - PAGESIZE * double_for_single_word;
+    }
+    else
+    {
+      printf("%s: palloc out of physical memory\n", selfie_name);
+
+      exit(EXITCODE_OUTOFPHYSICALMEMORY);
+    }
+  }
+
+  frame = next_page_frame;
+
+  next_page_frame = next_page_frame + PAGESIZE * double_for_single_word;
+
+  free_page_frame_memory = free_page_frame_memory - PAGESIZE * double_for_single_word;
+
+  if (pused() > peak_page_frame_memory)
+    peak_page_frame_memory = pused();
+
+  // strictly, touching is only necessary on boot levels higher than 0
+  return touch((uint64_t *)frame, PAGESIZE * double_for_single_word);
+}
+
+void pfree(uint64_t *frame)
+{
+  // link reclaimed page frame through its first word
+  *frame = (uint64_t)free_frames;
+
+  free_frames = frame;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  reclaimed_page_frame_memory = reclaimed_page_frame_memory + PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
+
+  reclaimed_frames = reclaimed_frames + 1;
+}
+
+uint64_t *palloc_superpage()
+{
+  uint64_t double_for_single_word;
+  uint64_t size;
+  uint64_t block;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  double_for_single_word = sizeof(uint64_t) / WORDSIZE;
+
+  size = SUPERPAGESIZE * double_for_single_word;
+
+  // superpages are contiguous and never use memory beyond physical memory,
+  // losing one page frame to alignment
+  if (allocated_page_frame_memory + size + PAGESIZE * double_for_single_word >
+      PHYSICALMEMORYSIZE * double_for_single_word)
+    return (uint64_t *)0;
+
+  // on boot level 0 allocate zeroed memory
+  block = (uint64_t)zmalloc(size + PAGESIZE * double_for_single_word);
+
+  allocated_page_frame_memory = allocated_page_frame_memory + size + PAGESIZE * double_for_single_word;
+
+  if (pused() > peak_page_frame_memory)
+    peak_page_frame_memory = pused();
+
+  // superpage frames must be page-aligned to work as page table index
+  return touch((uint64_t *)round_up(block, PAGESIZE * double_for_single_word), size);
+}
+
+void release_frame(uint64_t frame)
+{
+  uint64_t pinned;
+
+  // frames shared copy-on-write are freed with their last reference
+  if (get_frame_references(frame) > 1)
+  {
+    pinned = is_frame_pinned(frame);
+
+    unreference_frame(frame);
+
+    if (pinned)
+      if (get_frame_references(frame) == 1)
+        // last page mapping a content frame is gone
+        release_content_frame(frame);
+  }
+  else
+    pfree((uint64_t *)frame);
+}
+
+void release_page_table_entries(uint64_t *context, uint64_t *entries, uint64_t number_of_entries)
+{
+  uint64_t PTE;
+  uint64_t i;
+
+  i = 0;
+
+  while (i < number_of_entries)
+  {
+    PTE = *(entries + i);
+
+    if (PTE != 0)
+    {
+      // frames of hosted contexts belong to their parent
+      if (get_parent(context) == MY_CONTEXT)
+      {
+        if (has_PTE_flag(PTE, PTE_SWAPPED))
+          free_swap_slot(PTE / PAGESIZE);
+        else
+          release_frame(PTE - PTE % PAGESIZE);
+      }
+
+      *(entries + i) = 0;
+    }
+
+    i = i + 1;
+  }
+}
+
+void release_page_directory_entry(uint64_t *context, uint64_t *PDE)
+{
+  uint64_t leaf_pt;
+  uint64_t i;
+
+  leaf_pt = *PDE;
+
+  if (leaf_pt != 0)
+  {
+    if (leaf_pt % PAGESIZE == PTE_SUPERPAGE)
+    {
+      // frames of hosted contexts belong to their parent
+      if (get_parent(context) == MY_CONTEXT)
+      {
+        i = 0;
+
+        // superpage frames are returned to the free list page frame by page frame
+        while (i < NUMBEROFLEAFPTES)
+        {
+          // single word on 32-bit target occupies double word on 64-bit system
+          pfree((uint64_t *)(leaf_pt - PTE_SUPERPAGE + i * PAGESIZE * (sizeof(uint64_t) / WORDSIZE)));
+
+          i = i + 1;
+        }
+      }
+    }
+    else
+    {
+      release_page_table_entries(context, (uint64_t *)leaf_pt, NUMBEROFLEAFPTES);
+
+      pfree((uint64_t *)leaf_pt);
+    }
+
+    *PDE = 0;
+  }
+}
+
+void reclaim_frames(uint64_t *context)
+{
+  uint64_t *table;
+  uint64_t *mid_pd;
+  uint64_t root_PDE_offset;
+  uint64_t mid_PDE_offset;
+
+  // return all page frames and page tables of context to the free list
+
+  untrack_pages(context);
+
+  table = get_pt(context);
+
+  if (PAGETABLETREE == 0)
+    release_page_table_entries(context, table, NUMBEROFPAGES);
+  else
+  {
+    root_PDE_offset = 0;
+
+    while (root_PDE_offset < get_number_of_root_PDEs())
+    {
+      if (PAGETABLETREE == 1)
+        release_page_directory_entry(context, table + root_PDE_offset);
+      else
+      {
+        mid_pd = (uint64_t *)*(table + root_PDE_offset);
+
+        if (mid_pd != (uint64_t *)0)
+        {
+          mid_PDE_offset = 0;
+
+          while (mid_PDE_offset < NUMBEROFLEAFPTES)
+          {
+            release_page_directory_entry(context, mid_pd + mid_PDE_offset);
+
+            mid_PDE_offset = mid_PDE_offset + 1;
+          }
+
+          pfree(mid_pd);
+
+          *(table + root_PDE_offset) = 0;
+        }
+      }
+
+      root_PDE_offset = root_PDE_offset + 1;
+    }
+  }
+
+  // cached translations of context are stale
+  flush_tlb();
+}
+
+void share_page(uint64_t *context, uint64_t *child, uint64_t page)
+{
+  uint64_t frame;
+  uint64_t slot;
+
+  // map frame of page in context read-only into both context and child
+
+  // page tables of child may need frames
+  reserve_page_frames();
+
+  if (is_page_mapped(get_pt(context), page))
+  {
+    frame = get_frame_for_page(get_pt(context), page);
+
+    map_page(context, page, frame + PTE_READONLY);
+    map_page(child, page, frame + PTE_READONLY);
+
+    reference_frame(frame);
+
+    // both references may be evicted independently
+    track_page(child, page);
+  }
+  else if (is_page_swapped(get_pt(context), page))
+  {
+    // copy swapped page within swap space rather than paging it in
+    slot = allocate_swap_slot();
+
+    if (slot == SWAPSIZE * MEGABYTE / PAGESIZE)
+    {
+      printf("%s: forking page 0x%lX out of swap space\n", selfie_name, page);
+
+      exit(EXITCODE_OUTOFPHYSICALMEMORY);
+    }
+
+    copy_page(get_swap_slot(slot), get_page_content(context, page));
+
+    set_PTE_for_page(get_pt(child), page, slot * PAGESIZE + PTE_SWAPPED);
+
+    log_page_update(child, page);
+
+    page_outs = page_outs + 1;
+  }
+}
+
+void copy_on_write(uint64_t *context, uint64_t page)
+{
+  uint64_t frame;
+  uint64_t *copy;
+
+  // assert: page is mapped read-only in context
+
+  frame = get_frame_for_page(get_pt(context), page);
+
+  if (get_frame_references(frame) > 1)
+  {
+    copy = palloc();
+
+    copy_page(copy, (uint64_t *)frame);
+
+    unreference_frame(frame);
+
+    map_page(context, page, (uint64_t)copy);
+
+    copied_frames = copied_frames + 1;
+  }
+  else
+    // last reference, frame becomes writable in place
+    map_page(context, page, frame);
+
+  // private frames may be evicted
+  track_page(context, page);
+}
+
+void make_writable(uint64_t *context, uint64_t vaddr)
+{
+  // kernel stores into user memory must not be seen by other contexts
+
+  reserve_page_frames();
+
+  make_resident(context, vaddr);
+
+  if (is_virtual_address_mapped(get_pt(context), vaddr))
+    if (is_virtual_address_writable(get_pt(context), vaddr) == 0)
+      copy_on_write(context, get_page_of_virtual_address(vaddr));
+}
+
+void copy_page(uint64_t *to, uint64_t *from)
+{
+  uint64_t i;
+
+  i = 0;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  while (i < PAGESIZE / WORDSIZE)
+  {
+    *(to + i) = *(from + i);
+
+    i = i + 1;
+  }
+}
+
+uint64_t available_page_frames()
+{
+  uint64_t frame_size;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  frame_size = PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
+
+  if (allocated_page_frame_memory + MEGABYTE <=
+      PHYSICALMEMORYEXCESS * PHYSICALMEMORYSIZE * sizeof(uint64_t) / WORDSIZE)
+    // another block of page frames may still be allocated
+    return (reclaimed_page_frame_memory + free_page_frame_memory + MEGABYTE) / frame_size;
+  else
+    return (reclaimed_page_frame_memory + free_page_frame_memory) / frame_size;
+}
+
+uint64_t *get_swap_slot(uint64_t slot)
+{
+  return (uint64_t *)*(swap_slots + slot);
+}
+
+uint64_t allocate_swap_slot()
+{
+  uint64_t slot;
+
+  if (free_swap_slots != (uint64_t *)0)
+  {
+    // freed slots link to the next freed slot through their first word
+    slot = *(free_swap_slots + 1);
+
+    free_swap_slots = (uint64_t *)*free_swap_slots;
+
+    return slot;
+  }
+  else if (next_swap_slot < SWAPSIZE * MEGABYTE / PAGESIZE)
+  {
+    if (swap_slots == (uint64_t *)0)
+      swap_slots = zmalloc(SWAPSIZE * MEGABYTE / PAGESIZE * sizeof(uint64_t *));
+
+    // single word on 32-bit target occupies double word on 64-bit system
+    *(swap_slots + next_swap_slot) = (uint64_t)smalloc(PAGESIZE * (sizeof(uint64_t) / WORDSIZE));
+
+    next_swap_slot = next_swap_slot + 1;
+
+    return next_swap_slot - 1;
+  }
+  else
+    // swap space is full
+    return next_swap_slot;
+}
+
+void free_swap_slot(uint64_t slot)
+{
+  uint64_t *swap_slot;
+
+  swap_slot = get_swap_slot(slot);
+
+  // remember slot number in its second word
+  *swap_slot = (uint64_t)free_swap_slots;
+  *(swap_slot + 1) = slot;
+
+  free_swap_slots = swap_slot;
+}
+
+void track_page(uint64_t *context, uint64_t page)
+{
+  uint64_t *entry;
+
+  if (swap_policy == SWAPOFF)
+    return;
+  else if (get_parent(context) != MY_CONTEXT)
+    // frames of hosted contexts belong to their parent
+    return;
+  else if (is_code_address(context, get_virtual_address_of_page_start(page)))
+    // instructions are fetched without page faults
+    return;
+  else if (get_PTE_address_for_page((uint64_t *)0, get_pt(context), page) == (uint64_t *)0)
+    // superpages are never swapped
+    return;
+  else if (get_frame_for_page(get_pt(context), page) == 0)
+    return;
+  else if (has_PTE_flag(get_PTE_for_page(get_pt(context), page), PTE_TRACKED))
+    return;
+
+  set_PTE_flag(get_pt(context), page, PTE_TRACKED);
+
+  if (free_resident_pages != (uint64_t *)0)
+  {
+    entry = free_resident_pages;
+
+    free_resident_pages = get_next_resident(entry);
+  }
+  else
+    entry = smalloc(RESIDENTPAGEENTRIES * sizeof(uint64_t));
+
+  set_next_resident(entry, (uint64_t *)0);
+  set_resident_context(entry, context);
+  set_resident_page(entry, page);
+  set_resident_age(entry, AGEMSB);
+  set_resident_slot(entry, 0);
+
+  // append in order of becoming resident
+  if (resident_pages == (uint64_t *)0)
+    resident_pages = entry;
+  else
+    set_next_resident(last_resident_page, entry);
+
+  last_resident_page = entry;
+
+  number_of_resident_pages = number_of_resident_pages + 1;
+}
+
+void untrack_page(uint64_t *previous, uint64_t *entry)
+{
+  if (previous == (uint64_t *)0)
+    resident_pages = get_next_resident(entry);
+  else
+    set_next_resident(previous, get_next_resident(entry));
+
+  if (last_resident_page == entry)
+    last_resident_page = previous;
+
+  if (clock_hand == entry)
+    clock_hand = get_next_resident(entry);
+
+  set_next_resident(entry, free_resident_pages);
+
+  free_resident_pages = entry;
+
+  number_of_resident_pages = number_of_resident_pages - 1;
+}
+
+void untrack_pages(uint64_t *context)
+{
+  uint64_t *previous;
+  uint64_t *entry;
+  uint64_t *next;
+
+  previous = (uint64_t *)0;
+
+  entry = resident_pages;
+
+  while (entry != (uint64_t *)0)
+  {
+    next = get_next_resident(entry);
+
+    if (get_resident_context(entry) == context)
+    {
+      if (get_resident_slot(entry) != 0)
+        free_swap_slot(get_resident_slot(entry) - 1);
+
+      untrack_page(previous, entry);
+    }
+    else
+      previous = entry;
+
+    entry = next;
+  }
+}
+
+uint64_t is_hosting(uint64_t *context)
+{
+  uint64_t *hosted_context;
+
+  // hypsters access memory of their guests' contexts directly
+  hosted_context = used_contexts;
+
+  while (hosted_context != (uint64_t *)0)
+  {
+    if (get_parent(hosted_context) == context)
+      return 1;
+
+    hosted_context = get_next_context(hosted_context);
+  }
+
+  return 0;
+}
+
+uint64_t is_page_evictable(uint64_t *entry)
+{
+  uint64_t *context;
+  uint64_t page;
+
+  context = get_resident_context(entry);
+  page    = get_resident_page(entry);
+
+  // frames shared copy-on-write are freed when all references are evicted
+  if (is_hosting(context))
+    return 0;
+  else if (get_frame_for_page(get_pt(context), page) == 0)
+    return 0;
+  else if (is_frame_pinned(get_frame_for_page(get_pt(context), page)))
+    // evicting pinned frames frees no memory
+    return 0;
+  else
+    return 1;
+}
+
+void age_resident_pages()
+{
+  uint64_t *entry;
+  uint64_t *table;
+  uint64_t page;
+  uint64_t age;
+
+  // shift accessed bits into aging counters, most recent first
+
+  entry = resident_pages;
+
+  while (entry != (uint64_t *)0)
+  {
+    table = get_pt(get_resident_context(entry));
+    page  = get_resident_page(entry);
+
+    age = get_resident_age(entry) / 2;
+
+    if (has_PTE_flag(get_PTE_for_page(table, page), PTE_ACCESSED))
+    {
+      age = age + AGEMSB;
+
+      clear_PTE_flag(table, page, PTE_ACCESSED);
+
+      // next access through TLB sets accessed bit again
+      invalidate_tlb_page(table, page);
+    }
+
+    set_resident_age(entry, age);
+
+    entry = get_next_resident(entry);
+  }
+}
+
+uint64_t *select_victim_page()
+{
+  uint64_t *entry;
+  uint64_t *victim;
+  uint64_t *table;
+  uint64_t page;
+  uint64_t steps;
+
+  if (swap_policy == SWAPCLOCK)
+  {
+    steps = 0;
+
+    // at most two rounds: first clears accessed bits, second finds victim
+    while (steps <= 2 * number_of_resident_pages)
+    {
+      if (clock_hand == (uint64_t *)0)
+        clock_hand = resident_pages;
+
+      if (clock_hand == (uint64_t *)0)
+        return (uint64_t *)0;
+
+      entry = clock_hand;
+
+      clock_hand = get_next_resident(entry);
+
+      if (is_page_evictable(entry))
+      {
+        table = get_pt(get_resident_context(entry));
+        page  = get_resident_page(entry);
+
+        if (has_PTE_flag(get_PTE_for_page(table, page), PTE_ACCESSED))
+        {
+          // second chance
+          clear_PTE_flag(table, page, PTE_ACCESSED);
+
+          invalidate_tlb_page(table, page);
+        }
+        else
+          return entry;
+      }
+
+      steps = steps + 1;
+    }
+
+    return (uint64_t *)0;
+  }
+
+  if (swap_policy == SWAPLRU)
+    // account for accesses since last timer interrupt
+    age_resident_pages();
+
+  victim = (uint64_t *)0;
+
+  entry = resident_pages;
+
+  while (entry != (uint64_t *)0)
+  {
+    if (is_page_evictable(entry))
+    {
+      if (swap_policy == SWAPFIFO)
+        // oldest resident page first
+        return entry;
+      else if (victim == (uint64_t *)0)
+        victim = entry;
+      else if (get_resident_age(entry) < get_resident_age(victim))
+        // least recently used, ties in FIFO order
+        victim = entry;
+    }
+
+    entry = get_next_resident(entry);
+  }
+
+  return victim;
+}
+
+uint64_t evict_page()
+{
+  uint64_t *victim;
+  uint64_t *previous;
+  uint64_t *context;
+  uint64_t *table;
+  uint64_t page;
+  uint64_t PTE;
+  uint64_t slot;
+
+  victim = select_victim_page();
+
+  if (victim == (uint64_t *)0)
+    return 0;
+
+  context = get_resident_context(victim);
+  table   = get_pt(context);
+  page    = get_resident_page(victim);
+
+  PTE = get_PTE_for_page(table, page);
+
+  if (get_resident_slot(victim) == 0)
+    slot = allocate_swap_slot();
+  else
+    slot = get_resident_slot(victim) - 1;
+
+  if (slot == SWAPSIZE * MEGABYTE / PAGESIZE)
+    // out of swap space
+    return 0;
+
+  if (has_PTE_flag(PTE, PTE_DIRTY) + (get_resident_slot(victim) == 0) > 0)
+  {
+    copy_page(get_swap_slot(slot), (uint64_t *)(PTE - PTE % PAGESIZE));
+
+    page_outs = page_outs + 1;
+  }
+  else
+    // swap space still holds clean copy of page
+    clean_evictions = clean_evictions + 1;
+
+  set_PTE_for_page(table, page, slot * PAGESIZE + PTE_SWAPPED);
+
+  invalidate_tlb_page(table, page);
+
+  log_page_update(context, page);
+
+  // frame is reused for different page
+  flush_all_caches();
+
+  release_frame(PTE - PTE % PAGESIZE);
+
+  // slot now belongs to page table entry
+  set_resident_slot(victim, 0);
+
+  previous = (uint64_t *)0;
+
+  if (victim != resident_pages)
+  {
+    previous = resident_pages;
+
+    while (get_next_resident(previous) != victim)
+      previous = get_next_resident(previous);
+  }
+
+  untrack_page(previous, victim);
+
+  return 1;
+}
+
+void reserve_page_frames()
+{
+  // evict pages until a page and its page tables can be mapped
+  if (swap_policy != SWAPOFF)
+    if (available_page_frames() < 3)
+    {
+      release_content_frames();
+
+      while (available_page_frames() < 3)
+        if (evict_page() == 0)
+          return;
+    }
+}
+
+uint64_t swap_in_page(uint64_t *context, uint64_t page)
+{
+  uint64_t slot;
+  uint64_t *swap_slot;
+  uint64_t *frame;
+
+  reserve_page_frames();
+
+  if (pavailable() == 0)
+    return 0;
+
+  slot = get_PTE_for_page(get_pt(context), page) / PAGESIZE;
+
+  swap_slot = get_swap_slot(slot);
+
+  frame = palloc();
+
+  copy_page(frame, swap_slot);
+
+  // clear swap slot entry before mapping frame
+  set_PTE_for_page(get_pt(context), page, 0);
+
+  map_page(context, page, (uint64_t)frame);
+
+  track_page(context, page);
+
+  // swap slot keeps clean copy of page until it becomes dirty
+  set_resident_slot(last_resident_page, slot + 1);
+
+  page_ins = page_ins + 1;
+
+  return 1;
+}
+
+void make_resident(uint64_t *context, uint64_t vaddr)
+{
+  // kernel accesses to user memory page in swapped pages
+
+  if (swap_policy != SWAPOFF)
+    if (is_page_swapped(get_pt(context), get_page_of_virtual_address(vaddr)))
+      if (swap_in_page(context, get_page_of_virtual_address(vaddr)) == 0)
+      {
+        printf("%s: swapping in page 0x%lX out of physical memory\n", selfie_name, get_page_of_virtual_address(vaddr));
+
+        exit(EXITCODE_OUTOFPHYSICALMEMORY);
+      }
+}
+
+uint64_t *get_page_content(uint64_t *context, uint64_t page)
+{
+  if (is_page_swapped(get_pt(context), page))
+    return get_swap_slot(get_PTE_for_page(get_pt(context), page) / PAGESIZE);
+  else
+    return (uint64_t *)get_frame_for_page(get_pt(context), page);
+}
+
+void merge_page(uint64_t *context, uint64_t page, uint64_t frame)
+{
+  uint64_t old_frame;
+
+  // map page read-only to identical frame, stores split it again
+
+  old_frame = get_frame_for_page(get_pt(context), page);
+
+  reference_frame(frame);
+
+  pin_frame(frame);
+
+  map_page(context, page, frame + PTE_READONLY);
+
+  if (get_frame_references(old_frame) == 1)
+    saved_frames = saved_frames + 1;
+
+  release_frame(old_frame);
+
+  merged_pages = merged_pages + 1;
+}
+
+uint64_t merge_candidate(uint64_t *context, uint64_t page, uint64_t hash)
+{
+  uint64_t *bucket;
+  uint64_t *previous;
+  uint64_t *entry;
+  uint64_t *candidate_table;
+  uint64_t frame;
+  uint64_t candidate_frame;
+
+  frame = get_frame_for_page(get_pt(context), page);
+
+  bucket = merge_candidates + hash % CANDIDATEBUCKETS;
+
+  previous = (uint64_t *)0;
+
+  entry = (uint64_t *)*bucket;
+
+  while (entry != (uint64_t *)0)
+  {
+    if (get_candidate_hash(entry) == hash)
+    {
+      candidate_table = get_pt(get_candidate_context(entry));
+
+      candidate_frame = get_frame_for_page(candidate_table, get_candidate_page(entry));
+
+      // candidate may have changed or been swapped out since it was seen
+      if (candidate_frame != 0)
+        if (candidate_frame != frame)
+          if (is_frame_content(candidate_frame, (uint64_t *)frame))
+          {
+            // candidate frame becomes stable shared frame referenced by table
+            reference_frame(candidate_frame);
+
+            insert_content_frame(candidate_frame, hash);
+
+            map_page(get_candidate_context(entry), get_candidate_page(entry), candidate_frame + PTE_READONLY);
+
+            merge_page(context, page, candidate_frame);
+
+            if (previous == (uint64_t *)0)
+              *bucket = (uint64_t)get_next_candidate(entry);
+            else
+              set_next_candidate(previous, get_next_candidate(entry));
+
+            set_next_candidate(entry, free_candidates);
+
+            free_candidates = entry;
+
+            return 1;
+          }
+    }
+
+    previous = entry;
+
+    entry = get_next_candidate(entry);
+  }
+
+  // remember page for merging with identical pages seen later
+
+  if (free_candidates != (uint64_t *)0)
+  {
+    entry = free_candidates;
+
+    free_candidates = get_next_candidate(entry);
+  }
+  else
+    entry = smalloc(CANDIDATEENTRIES * sizeof(uint64_t));
+
+  set_next_candidate(entry, (uint64_t *)*bucket);
+  set_candidate_hash(entry, hash);
+  set_candidate_context(entry, context);
+  set_candidate_page(entry, page);
+
+  *bucket = (uint64_t)entry;
+
+  return 0;
+}
+
+void scan_page(uint64_t *context, uint64_t page)
+{
+  uint64_t frame;
+  uint64_t hash;
+  uint64_t shared_frame;
+
+  if (is_code_address(context, get_virtual_address_of_page_start(page)))
+    // code is shared already
+    return;
+  else if (get_PTE_address_for_page((uint64_t *)0, get_pt(context), page) == (uint64_t *)0)
+    // superpages are not merged
+    return;
+
+  frame = get_frame_for_page(get_pt(context), page);
+
+  if (frame == 0)
+    return;
+
+  hash = hash_page_content((uint64_t *)frame);
+
+  shared_frame = find_content_frame((uint64_t *)frame, hash);
+
+  if (shared_frame == 0)
+    merge_candidate(context, page, hash);
+  else if (shared_frame != frame)
+    merge_page(context, page, shared_frame);
+}
+
+void scan_identical_pages()
+{
+  uint64_t *context;
+  uint64_t merged;
+  uint64_t page;
+  uint64_t i;
+  uint64_t *entry;
+
+  if (merge_candidates == (uint64_t *)0)
+    merge_candidates = zmalloc(CANDIDATEBUCKETS * sizeof(uint64_t *));
+
+  // shared frames of pages split since last scan
+  release_content_frames();
+
+  merged = merged_pages;
+
+  context = used_contexts;
+
+  while (context != (uint64_t *)0)
+  {
+    // frames of hosted contexts belong to their parent and
+    // frames of hosting contexts are mapped by their guests
+    if (get_parent(context) == MY_CONTEXT)
+      if (is_hosting(context) == 0)
+      {
+        page = get_lowest_lo_page(context);
+
+        while (page < get_highest_lo_page(context))
+        {
+          scan_page(context, page);
+
+          page = page + 1;
+        }
+
+        page = get_lowest_hi_page(context);
+
+        while (page < get_highest_hi_page(context))
+        {
+          scan_page(context, page);
+
+          page = page + 1;
+        }
+      }
+
+    context = get_next_context(context);
+  }
+
+  // pages seen once are forgotten until the next scan
+
+  i = 0;
+
+  while (i < CANDIDATEBUCKETS)
+  {
+    entry = (uint64_t *)*(merge_candidates + i);
+
+    while (entry != (uint64_t *)0)
+    {
+      *(merge_candidates + i) = (uint64_t)get_next_candidate(entry);
+
+      set_next_candidate(entry, free_candidates);
+
+      free_candidates = entry;
+
+      entry = (uint64_t *)*(merge_candidates + i);
+    }
+
+    i = i + 1;
+  }
+
+  if (merged_pages > merged)
+    // freed frames are reused for different pages
+    flush_all_caches();
+
+  ksm_scans = ksm_scans + 1;
+}
+
+void map_and_store(uint64_t *context, uint64_t vaddr, uint64_t data)
+{
+  // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
+
+  if (is_virtual_address_mapped(get_pt(context), vaddr) == 0)
+    map_page(context, get_page_of_virtual_address(vaddr), (uint64_t)palloc());
+  else
+    make_writable(context, vaddr);
+
+  store_virtual_memory(get_pt(context), vaddr, data);
+}
+
+uint64_t hash_page_content(uint64_t *content)
+{
+  uint64_t hash;
+  uint64_t i;
+
+  hash = 0;
+
+  i = 0;
+
+  while (i < PAGESIZE / WORDSIZE)
+  {
+    // wrapping multiplicative hash over all words of page
+    hash = hash * 31 + *(content + i);
+
+    i = i + 1;
+  }
+
+  return hash;
+}
+
+uint64_t is_frame_content(uint64_t frame, uint64_t *content)
+{
+  uint64_t i;
+
+  i = 0;
+
+  while (i < PAGESIZE / WORDSIZE)
+  {
+    if (*((uint64_t *)frame + i) != *(content + i))
+      return 0;
+
+    i = i + 1;
+  }
+
+  return 1;
+}
+
+uint64_t find_content_frame(uint64_t *content, uint64_t hash)
+{
+  uint64_t *entry;
+
+  entry = (uint64_t *)*(content_frames + hash % CONTENTFRAMEBUCKETS);
+
+  while (entry != (uint64_t *)0)
+  {
+    if (get_content_hash(entry) == hash)
+      // rule out hash collisions
+      if (is_frame_content(get_content_frame(entry), content))
+        return get_content_frame(entry);
+
+    entry = get_next_content_frame(entry);
+  }
+
+  return 0;
+}
+
+void insert_content_frame(uint64_t frame, uint64_t hash)
+{
+  uint64_t *bucket;
+  uint64_t *entry;
+
+  // assert: frame holds its reference for the table
+
+  bucket = content_frames + hash % CONTENTFRAMEBUCKETS;
+
+  if (free_content_frames != (uint64_t *)0)
+  {
+    entry = free_content_frames;
+
+    free_content_frames = get_next_content_frame(entry);
+  }
+  else
+    entry = smalloc(CONTENTFRAMEENTRIES * sizeof(uint64_t));
+
+  set_next_content_frame(entry, (uint64_t *)*bucket);
+  set_content_hash(entry, hash);
+  set_content_frame(entry, frame);
+
+  *bucket = (uint64_t)entry;
+}
+
+void release_content_frames()
+{
+  uint64_t *bucket;
+  uint64_t *entry;
+  uint64_t freed;
+  uint64_t i;
+
+  // free frames no longer mapped by any context
+
+  freed = 0;
+
+  i = 0;
+
+  while (i < CONTENTFRAMEBUCKETS)
+  {
+    bucket = content_frames + i;
+
+    entry = (uint64_t *)*bucket;
+
+    while (entry != (uint64_t *)0)
+    {
+      if (get_frame_references(get_content_frame(entry)) == 1)
+      {
+        // only the table refers to frame
+        *bucket = (uint64_t)get_next_content_frame(entry);
+
+        pfree((uint64_t *)get_content_frame(entry));
+
+        set_next_content_frame(entry, free_content_frames);
+
+        free_content_frames = entry;
+
+        freed = 1;
+      }
+      else
+        bucket = entry;
+
+      entry = (uint64_t *)*bucket;
+    }
+
+    i = i + 1;
+  }
+
+  if (freed)
+    // freed frames are reused for different pages
+    flush_all_caches();
+}
+
+void release_content_frame(uint64_t frame)
+{
+  uint64_t *bucket;
+  uint64_t *entry;
+
+  // drop the reference of the table, frames of the loaded binary are not in it
+
+  bucket = content_frames + hash_page_content((uint64_t *)frame) % CONTENTFRAMEBUCKETS;
+
+  entry = (uint64_t *)*bucket;
+
+  while (entry != (uint64_t *)0)
+  {
+    if (get_content_frame(entry) == frame)
+    {
+      *bucket = (uint64_t)get_next_content_frame(entry);
+
+      pfree((uint64_t *)frame);
+
+      set_next_content_frame(entry, free_content_frames);
+
+      free_content_frames = entry;
+
+      // freed frame is reused for different pages
+      flush_all_caches();
+
+      return;
+    }
+
+    bucket = entry;
+
+    entry = (uint64_t *)*bucket;
+  }
+}
+
+void map_content_page(uint64_t *context, uint64_t page, uint64_t *content)
+{
+  uint64_t hash;
+  uint64_t frame;
+
+  hash = hash_page_content(content);
+
+  frame = find_content_frame(content, hash);
+
+  if (frame == 0)
+  {
+    frame = (uint64_t)palloc();
+
+    copy_page((uint64_t *)frame, content);
+
+    insert_content_frame(frame, hash);
+
+    content_pages = content_pages + 1;
+  }
+
+  // the table holds one reference, so stores always copy the frame
+  reference_frame(frame);
+
+  pin_frame(frame);
+
+  map_page(context, page, frame + PTE_READONLY);
+
+  uploaded_pages = uploaded_pages + 1;
+}
+
+void up_load_segment(uint64_t *context, uint64_t *binary, uint64_t start, uint64_t size, uint64_t *content)
+{
+  uint64_t baddr;
+  uint64_t i;
+
+  // assert: start is multiple of PAGESIZE
+
+  baddr = 0;
+
+  if (binary_frames)
+  {
+    // pages of loaded binary are frames already
+    while (baddr < size)
+    {
+      // the binary holds one reference, so stores always copy the frame
+      reference_frame((uint64_t)binary + baddr);
+
+      pin_frame((uint64_t)binary + baddr);
+
+      map_page(context, get_page_of_virtual_address(start + baddr), (uint64_t)binary + baddr + PTE_READONLY);
+
+      binary_pages = binary_pages + 1;
+
+      baddr = baddr + PAGESIZE;
+    }
+
+    return;
+  }
+
+  while (baddr < size)
+  {
+    i = 0;
+
+    // page content with zeroed remainder beyond the end of the segment
+    while (i < PAGESIZE / WORDSIZE)
+    {
+      if (baddr + i * WORDSIZE < size)
+        *(content + i) = load_word(binary, baddr + i * WORDSIZE, 1);
+      else
+        *(content + i) = 0;
+
+      i = i + 1;
+    }
+
+    map_content_page(context, get_page_of_virtual_address(start + baddr), content);
+
+    baddr = baddr + PAGESIZE;
+  }
+}
+
+void up_load_binary(uint64_t *context)
+{
+  uint64_t *content;
+
+  // assert: e_entry is multiple of PAGESIZE and INSTRUCTIONSIZE
+
+  set_pc(context, e_entry);
+
+  // setting up page table cache
+
+  set_lowest_lo_page(context, get_page_of_virtual_address(code_start));
+  set_highest_lo_page(context, get_lowest_lo_page(context));
+
+  // setting up memory segments
+
+  set_code_seg_start(context, code_start);
+  set_code_seg_size(context, code_size);
+  set_data_seg_start(context, data_start);
+  set_data_seg_size(context, data_size);
+  set_heap_seg_start(context, round_up(data_start + data_size, p_align));
+  set_program_break(context, get_heap_seg_start(context));
+
+  // identical code and data pages of all contexts share frames
+  content = smalloc(PAGESIZE / WORDSIZE * sizeof(uint64_t));
+
+  up_load_segment(context, code_binary, get_code_seg_start(context), code_size, content);
+  up_load_segment(context, data_binary, get_data_seg_start(context), data_size, content);
+}
+
+uint64_t up_load_string(uint64_t *context, char *s, uint64_t SP)
+{
+  uint64_t bytes;
+  uint64_t i;
+
+  bytes = round_up(string_length(s) + 1, WORDSIZE);
+
+  // allocate memory for storing string
+  SP = SP - bytes;
+
+  i = 0;
+
+  while (i < bytes)
+  {
+    map_and_store(context, SP + i, load_word((uint64_t *)s, i, 1));
+
+    i = i + WORDSIZE;
+  }
+
+  return SP;
+}
+
+void up_load_arguments(uint64_t *context, uint64_t argc, uint64_t *argv)
+{
+  /* upload arguments like a UNIX system
+
+      SP
+      |
+      V
+   | argc | argv[0] | ... | argv[n] | 0 | env[0] | ... | env[m] | 0 |
+
+     with argc > 0, n == argc - 1, and m == 0 (that is, env is empty) */
+  uint64_t SP;
+  uint64_t *vargv;
+  uint64_t i;
+
+  // the call stack grows top down
+  SP = VIRTUALMEMORYSIZE * GIGABYTE;
+
+  vargv = smalloc(argc * sizeof(uint64_t *));
+
+  i = 0;
+
+  // push program parameters onto the stack
+  while (i < argc)
+  {
+    SP = up_load_string(context, (char *)*(argv + i), SP);
+
+    // store pointer in virtual *argv
+    *(vargv + i) = SP;
+
+    i = i + 1;
+  }
+
+  // allocate memory for termination of env table
+  SP = SP - WORDSIZE;
+
+  // push null value to terminate env table
+  map_and_store(context, SP, 0);
+
+  // allocate memory for termination of argv table
+  SP = SP - WORDSIZE;
+
+  // push null value to terminate argv table
+  map_and_store(context, SP, 0);
+
+  // assert: i == argc
+
+  // push argv table onto the stack
+  while (i > 0)
+  {
+    // allocate memory for argv table entry
+    SP = SP - WORDSIZE;
+
+    i = i - 1;
+
+    // push argv table entry
+    map_and_store(context, SP, *(vargv + i));
+  }
+
+  // allocate memory for argc
+  SP = SP - WORDSIZE;
+
+  // push argc
+  map_and_store(context, SP, argc);
+
+  // store stack pointer value in stack pointer register
+  *(get_regs(context) + REG_SP) = SP;
+
+  // initialize frame pointer register for completeness (redundant)
+  *(get_regs(context) + REG_S0) = 0;
+}
+
+uint64_t handle_system_call(uint64_t *context)
+{
+  uint64_t a7;
+
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+
+  set_ec_syscall(context, get_ec_syscall(context) + 1);
+
+  a7 = *(get_regs(context) + REG_A7);
+  //printf("Handling syscall with id: %lu\n",a7);
+
+  if (a7 == SYSCALL_BRK)
+  {
+    if (is_gc_enabled(context))
+      implement_gc_brk(context);
+    else
+      implement_brk(context);
+  }
+  else if (a7 == SYSCALL_READ)
+    implement_read(context);
+  else if (a7 == SYSCALL_WRITE)
+    implement_write(context);
+  else if (a7 == SYSCALL_OPENAT)
+    implement_openat(context);
+  else if (a7 == SYSCALL_DUMMY)  // dummy_syscall
+    implement_dummy_syscall(context);
+  else if (a7 == SYSCALL_COUNT_SYSCALLS) // count_syscall
+    implement_count_syscalls(context);
+  else if (a7 == SYSCALL_FORK)
+    implement_fork(context); // fork
+  else if (a7 == SYSCALL_SEM_INIT) // Semaphores
+    implement_sem_init (context);
+  else if (a7 == SYSCALL_SEM_WAIT) // Semaphores
+    implement_sem_wait (context);
+  else if (a7 == SYSCALL_SEM_POST) // Semaphores
+    implement_sem_post (context);
+  else if (a7 == SYSCALL_LOCK_INIT) // locks
+    implement_lock_init (context);
+  else if (a7 == SYSCALL_LOCK_ACQUIRE) // locks
+    implement_lock_acquire (context);
+  else if (a7 == SYSCALL_LOCK_RELEASE) // locks
+    implement_lock_release (context);
+  else if (a7 == SYSCALL_NICE) // CFS
+    implement_nice(context);
+  else if (a7 == SYSCALL_TICKETS) // stride
+    implement_tickets(context);
+  else if (a7 == SYSCALL_EXIT)
+  {
+    implement_exit(context);
+
+    // Mark context as exited by setting blocked flag to special value
+    retire_context(context); // 0=ready, 1=blocked, 2=exited
+
+    // memory of exited context is not accessed anymore
+    reclaim_frames(context);
+    
+    return DONOTEXIT;
+  } else
+  {
+    printf("%s: unknown system call %lu\n", selfie_name, a7);
+
+    set_exit_code(context, EXITCODE_UNKNOWNSYSCALL);
+
+    return EXIT;
+  }
+
+  return DONOTEXIT;
+}
+
+void map_page_around_fault(uint64_t *context, uint64_t page)
+{
+  if (is_page_mapped(get_pt(context), page) == 0)
+    if (pavailable())
+    {
+      map_page(context, page, (uint64_t)palloc());
+
+      track_page(context, page);
+
+      if (is_heap_address(context, get_virtual_address_of_page_start(page)))
+        set_mc_mapped_heap(context, get_mc_mapped_heap(context) + PAGESIZE);
+
+      faultaround_pages = faultaround_pages + 1;
+    }
+}
+
+void map_pages_around_fault(uint64_t *context, uint64_t page)
+{
+  uint64_t lowest_page;
+  uint64_t highest_page;
+  uint64_t i;
+
+  if (is_heap_address(context, get_virtual_address_of_page_start(page)))
+  {
+    // heap pages up to the program break
+    lowest_page  = get_page_of_virtual_address(get_heap_seg_start(context));
+    highest_page = get_page_of_virtual_address(get_program_break(context) - 1);
+  }
+  else if (is_stack_address(context, get_virtual_address_of_page_start(page)))
+  {
+    // stack pages down to FAULTAROUND pages below SP that the stack
+    // grows into next, the gap to the heap is not mapped in advance
+    lowest_page  = get_page_of_virtual_address(*(get_regs(context) + REG_SP)) - FAULTAROUND;
+    highest_page = get_page_of_virtual_address(HIGHESTVIRTUALADDRESS);
+
+    if (lowest_page < get_page_of_virtual_address(round_up(get_program_break(context), PAGESIZE)))
+      lowest_page = get_page_of_virtual_address(round_up(get_program_break(context), PAGESIZE));
+  }
+  else
+    return;
+
+  i = 1;
+
+  while (i <= FAULTAROUND)
+  {
+    if (page + i <= highest_page)
+      map_page_around_fault(context, page + i);
+
+    if (page >= lowest_page + i)
+      map_page_around_fault(context, page - i);
+
+    i = i + 1;
+  }
+}
+
+uint64_t map_superpage(uint64_t *context, uint64_t page)
+{
+  uint64_t first_page;
+  uint64_t superframe;
+
+  if (SUPERPAGES == 0)
+    return 0;
+
+  first_page = page - get_leaf_PTE_offset(page);
+
+  // only heap regions that cover the whole superpage
+  if (get_virtual_address_of_page_start(first_page) < get_heap_seg_start(context))
+    return 0;
+  else if (get_virtual_address_of_page_start(first_page + NUMBEROFLEAFPTES) > get_program_break(context))
+    return 0;
+  else if (get_PDE_for_page((uint64_t *)0, get_pt(context), page) != 0)
+    // some pages of superpage are already mapped
+    return 0;
+
+  superframe = (uint64_t)palloc_superpage();
+
+  if (superframe == 0)
+    return 0;
+
+  set_PDE_for_superpage(get_pt(context), page, superframe);
+
+  // exploit spatial locality in page table caching
+  set_lowest_lo_page(context, lowest_page(first_page, get_lowest_lo_page(context)));
+  set_highest_lo_page(context, highest_page(first_page + NUMBEROFLEAFPTES - 1, get_highest_lo_page(context)));
+
+  // superpages overflow the log of page table updates
+  set_PTE_log_length(context, PTELOGSIZE + 1);
+
+  set_mc_mapped_heap(context, get_mc_mapped_heap(context) + SUPERPAGESIZE);
+
+  mapped_superpages = mapped_superpages + 1;
+
+  if (debug_map)
+    printf("%s: superpage 0x%04lX mapped to frame 0x%08lX in context %s\n", selfie_name,
+           first_page, superframe, get_name(context));
+
+  return 1;
+}
+
+uint64_t handle_page_fault(uint64_t *context)
+{
+  uint64_t page;
+
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+
+  set_ec_page_fault(context, get_ec_page_fault(context) + 1);
+
+  page = get_fault(context);
+
+  // make room by evicting pages if swapping is on, possibly including page
+  reserve_page_frames();
+
+  if (is_page_swapped(get_pt(context), page))
+  {
+    if (swap_in_page(context, page))
+      return DONOTEXIT;
+
+    printf("%s: page fault at 0x%lX out of physical memory\n", selfie_name, page);
+
+    set_exit_code(context, EXITCODE_OUTOFPHYSICALMEMORY);
+
+    return EXIT;
+  }
+
+  if (is_page_mapped(get_pt(context), page))
+    if (get_frame_references(get_frame_for_page(get_pt(context), page)) == 1)
+    {
+      // store into frame no longer shared, no copy needed
+      copy_on_write(context, page);
+
+      return DONOTEXIT;
+    }
+
+  if (pavailable())
+  {
+    if (is_page_mapped(get_pt(context), page))
+      // store into frame shared copy-on-write
+      copy_on_write(context, page);
+    else if (map_superpage(context, page) == 0)
+    {
+      map_page(context, page, (uint64_t)palloc());
+
+      track_page(context, page);
+
+      if (is_heap_address(context, get_virtual_address_of_page_start(page)))
+        set_mc_mapped_heap(context, get_mc_mapped_heap(context) + PAGESIZE);
+
+      if (FAULTAROUND > 0)
+        map_pages_around_fault(context, page);
+    }
+
+    return DONOTEXIT;
+  }
+  else
+  {
+    printf("%s: page fault at 0x%lX out of physical memory\n", selfie_name, page);
+
+    set_exit_code(context, EXITCODE_OUTOFPHYSICALMEMORY);
+
+    return EXIT;
+  }
+}
+
+uint64_t handle_division_by_zero(uint64_t *context)
+{
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+
+  if (record)
+  {
+    printf("%s: division by zero, replaying...\n", selfie_name);
+
+    replay_trace();
+
+    set_exit_code(context, EXITCODE_NOERROR);
+  }
+  else
+  {
+    printf("%s: division by zero\n", selfie_name);
+
+    set_exit_code(context, EXITCODE_DIVISIONBYZERO);
+  }
+
+  return EXIT;
+}
+
+uint64_t handle_timer(uint64_t *context)
+{
+  set_exception(context, EXCEPTION_NOEXCEPTION);
+
+  set_ec_timer(context, get_ec_timer(context) + 1);
+
+  if (swap_policy == SWAPLRU)
+    age_resident_pages();
+
+  if (KSMINTERVAL > 0)
+  {
+    ksm_ticks = ksm_ticks + 1;
+
+    if (ksm_ticks == KSMINTERVAL)
+    {
+      scan_identical_pages();
+
+      ksm_ticks = 0;
+    }
+  }
+
+  if (snapshot_name != (char *)0)
+    if (get_ec_timer(context) == snapshot_timeslices)
+      save_snapshot(context);
+
+  return DONOTEXIT;
+}
+
+// -------------------------------------------------------------------------
+// ------------------------- SCHEDULER FUNCTIONS ---------------------------
+// -------------------------------------------------------------------------
+
+// Simple pseudo-random number generator (Linear Congruential Generator)
+uint64_t simple_rand() {
+  uint64_t temp;
+  
+  temp = random_seed * 1103515245;
+  temp = temp + 12345;
+  random_seed = temp % 2147483648; // 0x7FFFFFFF + 1
+  
+  return random_seed;
+}
+
+// Runnable contexts are not blocked, contexts hosted by a guest kernel
+// only run when their parent switches to them
+uint64_t is_schedulable(uint64_t *context) {
+  if (get_blocked(context) == 0)
+    if (get_parent(context) == MY_CONTEXT)
+      return 1;
 
-  set_parent(context, parent);
-  set_virtual_context(context, vctxt);
+  return 0;
+}
 
-  // profile
-  set_ic_all(context, 0);
-  set_lc_malloc(context, 0);
-  set_ec_syscall(context, 0);
-  set_ec_page_fault(context, 0);
-  set_ec_timer(context, 0);
-  set_mc_stack_peak(context, HIGHESTVIRTUALADDRESS);
-  set_mc_mapped_heap(context, 0);
+// Count runnable contexts in the used_contexts list
+uint64_t count_runnable_contexts() {
+  uint64_t *context;
+  uint64_t count;
 
-  // garbage collector
-  set_used_list_head(context, (uint64_t *)0);
-  set_free_list_head(context, (uint64_t *)0);
-  set_gcs_in_period(context, 0);
-  set_use_gc_kernel(context, GC_DISABLED);
+  context = used_contexts;
+  count = 0;
 
-  //New Settings
-  set_id_context(context, id_ctxt_counter); // fork
-  id_ctxt_counter = id_ctxt_counter + 1;
+  while (context != (uint64_t *)0) {
+    if (is_schedulable(context))
+      count = count + 1;
+    
+    context = get_next_context(context);
+  }
 
-  set_ptr_parent_ctx(context, (uint64_t *)0); // fork: seteamos el parent_context a null
-  set_vruntime(context, 0); // CFS: inicializar vruntime a 0
+  return count;
 }
 
-uint64_t *find_context(uint64_t *parent, uint64_t *vctxt)
-{
+// Select a random runnable context from the list
+uint64_t *select_random_context() {
+  uint64_t num_runnable;
+  uint64_t random_index;
   uint64_t *context;
+  uint64_t i;
+
+  num_runnable = count_runnable_contexts();
+
+  if (num_runnable == 0)
+    return (uint64_t *)0;
+
+  random_index = simple_rand();
+  random_index = random_index % num_runnable;
 
   context = used_contexts;
+  i = 0;
 
-  while (context != (uint64_t *)0)
-  {
-    if (get_parent(context) == parent)
-      if (get_virtual_context(context) == vctxt)
+  while (context != (uint64_t *)0) {
+    if (is_schedulable(context)) {
+      if (i == random_index)
         return context;
-
+      i = i + 1;
+    }
     context = get_next_context(context);
   }
 
   return (uint64_t *)0;
 }
 
-uint64_t *find_context_by_id (uint64_t id) {// Semaphores
-	uint64_t *cur;
+// Run queue is ordered by pass with stride scheduling and by vruntime otherwise
+uint64_t get_run_queue_key(uint64_t *context) {
+  if (scheduler_type == SCHEDULER_STRIDE)
+    return get_pass(context);
+  else
+    return get_vruntime(context);
+}
 
-	cur = used_contexts;
-	while (cur != (uint64_t *) 0) {
-		if (get_id_context (cur) == id){
-			return cur;
-		}
+// Order of the run queue: smaller key first, and among equal
+// keys the most recently created context first, as in used_contexts
+uint64_t is_queued_before(uint64_t *context, uint64_t *other) {
+  if (get_run_queue_key(context) < get_run_queue_key(other))
+    return 1;
+  else if (get_run_queue_key(context) == get_run_queue_key(other))
+    if (get_id_context(context) > get_id_context(other))
+      return 1;
 
-		cur = get_next_context(cur);
-	}
+  return 0;
+}
 
-	return (uint64_t *) 0;
+// Missing children of contexts in the run queue count as black
+uint64_t is_red_in_run_queue(uint64_t *context) {
+  if (context != (uint64_t *)0)
+    if (get_rq_color(context) == RQ_RED)
+      return 1;
+
+  return 0;
 }
 
-void free_context(uint64_t *context)
-{
-  set_next_context(context, free_contexts);
+uint64_t is_black_below_root(uint64_t *context) {
+  if (context != run_queue)
+    if (is_red_in_run_queue(context) == 0)
+      return 1;
 
-  free_contexts = context;
+  return 0;
 }
 
-uint64_t *delete_context(uint64_t *context, uint64_t *from)
-{
-  if (get_next_context(context) != (uint64_t *)0)
-    set_prev_context(get_next_context(context), get_prev_context(context));
+// Put by in the place of context under the parent of context
+void replace_in_run_queue(uint64_t *context, uint64_t *by) {
+  uint64_t *parent;
 
-  if (get_prev_context(context) != (uint64_t *)0)
-  {
-    set_next_context(get_prev_context(context), get_next_context(context));
-    set_prev_context(context, (uint64_t *)0);
-  }
-  else
-    from = get_next_context(context);
+  parent = get_rq_up(context);
 
-  free_context(context);
+  if (parent == (uint64_t *)0)
+    run_queue = by;
+  else if (context == get_rq_left(parent))
+    set_rq_left(parent, by);
+  else
+    set_rq_right(parent, by);
 
-  return from;
+  if (by != (uint64_t *)0)
+    set_rq_up(by, parent);
 }
 
-// -----------------------------------------------------------------
-// -------------------------- MICROKERNEL --------------------------
-// -----------------------------------------------------------------
-
-uint64_t *create_context(uint64_t *parent, uint64_t *vctxt)
-{
-  uint64_t *context;
+void rotate_run_queue_left(uint64_t *context) {
+  uint64_t *right;
 
-  context = new_context();
+  right = get_rq_right(context);
 
-  init_context(context, parent, vctxt);
+  set_rq_right(context, get_rq_left(right));
 
-  // Initialize lockdep fields
-  set_held_locks_head(context, (uint64_t *)0);
-  set_held_locks_count(context, 0);
+  if (get_rq_left(right) != (uint64_t *)0)
+    set_rq_up(get_rq_left(right), context);
 
-  if (debug_create)
-    printf("%s: parent context %s created child context %s\n", selfie_name,
-           get_name(parent), get_name(used_contexts));
+  replace_in_run_queue(context, right);
 
-  return context;
+  set_rq_left(right, context);
+  set_rq_up(context, right);
 }
 
-uint64_t *cache_context(uint64_t *vctxt)
-{
-  uint64_t *context;
+void rotate_run_queue_right(uint64_t *context) {
+  uint64_t *left;
 
-  // find cached context on my boot level
-  context = find_context(current_context, vctxt);
+  left = get_rq_left(context);
 
-  if (context == (uint64_t *)0)
-    // create cached context on my boot level
-    context = create_context(current_context, vctxt);
+  set_rq_left(context, get_rq_right(left));
 
-  return context;
+  if (get_rq_right(left) != (uint64_t *)0)
+    set_rq_up(get_rq_right(left), context);
+
+  replace_in_run_queue(context, left);
+
+  set_rq_right(left, context);
+  set_rq_up(context, left);
 }
 
-void save_context(uint64_t *context)
-{
-  uint64_t *parent_table;
-  uint64_t *vctxt;
-  uint64_t r;
-  uint64_t *pregs;
-  uint64_t *vregs;
+// Insert a ready context into the run queue unless it is queued already
+void enqueue_context(uint64_t *context) {
+  uint64_t *parent;
+  uint64_t *node;
+  uint64_t *uncle;
 
-  // save machine state
-  set_pc(context, pc);
+  if (scheduler_type == SCHEDULER_MLFQ) {
+    append_to_level(context);
 
-  if (get_parent(context) != MY_CONTEXT)
-  {
-    // upload changes in context to virtual context in parent address space
-    parent_table = get_pt(get_parent(context));
+    return;
+  } else if (get_rq_color(context) != 0)
+    return;
 
-    vctxt = get_virtual_context(context);
+  parent = (uint64_t *)0;
+  node   = run_queue;
 
-    store_virtual_memory(parent_table, program_counter(vctxt), get_pc(context));
+  while (node != (uint64_t *)0) {
+    parent = node;
 
-    r = 0;
+    if (is_queued_before(context, node))
+      node = get_rq_left(node);
+    else
+      node = get_rq_right(node);
+  }
 
-    pregs = get_regs(context);
-    vregs = (uint64_t *)load_virtual_memory(parent_table, regs(vctxt));
+  set_rq_left(context, (uint64_t *)0);
+  set_rq_right(context, (uint64_t *)0);
+  set_rq_up(context, parent);
+  set_rq_color(context, RQ_RED);
 
-    while (r < NUMBEROFREGISTERS)
-    {
-      store_virtual_memory(parent_table, (uint64_t)(vregs + r), *(pregs + r));
+  queued_contexts = queued_contexts + 1;
+  queued_weight   = queued_weight + get_weight(context);
 
-      r = r + 1;
-    }
+  if (parent == (uint64_t *)0)
+    run_queue = context;
+  else if (is_queued_before(context, parent))
+    set_rq_left(parent, context);
+  else
+    set_rq_right(parent, context);
 
-    store_virtual_memory(parent_table, program_break(vctxt), get_program_break(context));
+  // the root is black, so a red parent always has a parent
+  while (is_red_in_run_queue(get_rq_up(context))) {
+    parent = get_rq_up(context);
+    node   = get_rq_up(parent);
 
-    store_virtual_memory(parent_table, exception(vctxt), get_exception(context));
-    store_virtual_memory(parent_table, fault(vctxt), get_fault(context));
-    store_virtual_memory(parent_table, exit_code(vctxt), get_exit_code(context));
+    if (parent == get_rq_left(node)) {
+      uncle = get_rq_right(node);
 
-    // garbage collector state (only necessary if context is gced by different gcs)
+      if (is_red_in_run_queue(uncle)) {
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(uncle, RQ_BLACK);
+        set_rq_color(node, RQ_RED);
 
-    store_virtual_memory(parent_table, used_list_head(vctxt), (uint64_t)get_used_list_head(context));
-    store_virtual_memory(parent_table, free_list_head(vctxt), (uint64_t)get_free_list_head(context));
-    store_virtual_memory(parent_table, gcs_in_period(vctxt), get_gcs_in_period(context));
-    store_virtual_memory(parent_table, use_gc_kernel(vctxt), get_use_gc_kernel(context));
-  }
+        context = node;
+      } else {
+        if (context == get_rq_right(parent)) {
+          context = parent;
 
-  set_ic_all(context, get_total_number_of_instructions() - get_ic_all(context));
+          rotate_run_queue_left(context);
 
-  if (*(get_regs(context) + REG_SP) < get_mc_stack_peak(context))
-    // keep track of peak amount of stack allocation
-    set_mc_stack_peak(context, *(get_regs(context) + REG_SP));
-}
+          parent = get_rq_up(context);
+        }
 
-uint64_t create_semaphore (uint64_t value) { // Semaphores
-	uint64_t *sem;
-	uint64_t sem_id;
-  uint64_t i;
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(node, RQ_RED);
 
-	sem_id = next_sem_id;
-	next_sem_id = next_sem_id + 1;
-	sem = used_semaphores + (sem_id * SEMAPHOREENTRIES);
+        rotate_run_queue_right(node);
+      }
+    } else {
+      uncle = get_rq_left(node);
 
-	set_sem_value (sem, value);
-	set_sem_n_waiters (sem, 0);
-	set_sem_waiters (sem, smalloc (sizeof (uint64_t) * 64)); // At most 64 waiters
+      if (is_red_in_run_queue(uncle)) {
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(uncle, RQ_BLACK);
+        set_rq_color(node, RQ_RED);
 
-	i = 0;
-	while (i < 64) {
-      *(get_sem_waiters (sem) + i) = -1;
-	  i = i + 1;
-	}
+        context = node;
+      } else {
+        if (context == get_rq_left(parent)) {
+          context = parent;
 
-	return sem_id;
-}
+          rotate_run_queue_right(context);
 
-uint64_t create_lock() { // Locks
-	uint64_t *lock;
-	uint64_t lock_id;
-	uint64_t sem_id;
+          parent = get_rq_up(context);
+        }
 
-	lock_id = next_lock_id;
-	next_lock_id = next_lock_id + 1;
-	lock = used_locks + (lock_id * LOCKENTRIES);
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(node, RQ_RED);
 
-	// Creamos un semáforo binario inicializado en 1
-	sem_id = create_semaphore(1);
-	set_lock_semaphore(lock, sem_id);
-	set_lock_owner(lock, -1); // Sin propietario al inicio
+        rotate_run_queue_left(node);
+      }
+    }
+  }
 
-	return lock_id;
+  set_rq_color(run_queue, RQ_BLACK);
 }
 
-uint64_t lowest_page(uint64_t page, uint64_t lo)
-{
-  if (page < lo)
-    return page;
-  else
-    return lo;
-}
+// Restore the black height after a black context was removed above context,
+// which may be missing, so its parent is passed along
+void rebalance_run_queue(uint64_t *context, uint64_t *parent) {
+  uint64_t *sibling;
 
-uint64_t highest_page(uint64_t page, uint64_t hi)
-{
-  if (page >= hi)
-    // only lo <= page < hi will be cached
-    return page + 1;
-  else
-    return hi;
-}
+  while (is_black_below_root(context)) {
+    if (context == get_rq_left(parent)) {
+      sibling = get_rq_right(parent);
 
-void map_page(uint64_t *context, uint64_t page, uint64_t frame)
-{
-  uint64_t *table;
+      if (is_red_in_run_queue(sibling)) {
+        set_rq_color(sibling, RQ_BLACK);
+        set_rq_color(parent, RQ_RED);
 
-  if (frame != 0)
-  {
-    table = get_pt(context);
+        rotate_run_queue_left(parent);
 
-    if (get_frame_for_page(table, page) == 0)
-    {
-      set_PTE_for_page(table, page, frame);
+        sibling = get_rq_right(parent);
+      }
 
-      // exploit spatial locality in page table caching
-      if (page <= get_page_of_virtual_address(get_program_break(context) - WORDSIZE))
-      {
-        set_lowest_lo_page(context, lowest_page(page, get_lowest_lo_page(context)));
-        set_highest_lo_page(context, highest_page(page, get_highest_lo_page(context)));
+      if (is_red_in_run_queue(get_rq_left(sibling)) + is_red_in_run_queue(get_rq_right(sibling)) == 0) {
+        set_rq_color(sibling, RQ_RED);
+
+        context = parent;
+        parent  = get_rq_up(context);
+      } else {
+        if (is_red_in_run_queue(get_rq_right(sibling)) == 0) {
+          set_rq_color(get_rq_left(sibling), RQ_BLACK);
+          set_rq_color(sibling, RQ_RED);
+
+          rotate_run_queue_right(sibling);
+
+          sibling = get_rq_right(parent);
+        }
+
+        set_rq_color(sibling, get_rq_color(parent));
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(get_rq_right(sibling), RQ_BLACK);
+
+        rotate_run_queue_left(parent);
+
+        context = run_queue;
       }
-      else
-      {
-        set_lowest_hi_page(context, lowest_page(page, get_lowest_hi_page(context)));
-        set_highest_hi_page(context, highest_page(page, get_highest_hi_page(context)));
+    } else {
+      sibling = get_rq_left(parent);
+
+      if (is_red_in_run_queue(sibling)) {
+        set_rq_color(sibling, RQ_BLACK);
+        set_rq_color(parent, RQ_RED);
+
+        rotate_run_queue_right(parent);
+
+        sibling = get_rq_left(parent);
       }
-    } // else assert: frame == get_frame_for_page(table, page)
-  }
 
-  if (debug_map)
-    printf("%s: page 0x%04lX mapped to frame 0x%08lX in context %s\n", selfie_name,
-           page, (uint64_t)frame, get_name(context));
-}
+      if (is_red_in_run_queue(get_rq_left(sibling)) + is_red_in_run_queue(get_rq_right(sibling)) == 0) {
+        set_rq_color(sibling, RQ_RED);
+
+        context = parent;
+        parent  = get_rq_up(context);
+      } else {
+        if (is_red_in_run_queue(get_rq_left(sibling)) == 0) {
+          set_rq_color(get_rq_right(sibling), RQ_BLACK);
+          set_rq_color(sibling, RQ_RED);
+
+          rotate_run_queue_left(sibling);
+
+          sibling = get_rq_left(parent);
+        }
 
-void restore_region(uint64_t *context, uint64_t *table, uint64_t *parent_table, uint64_t lo, uint64_t hi)
-{
-  uint64_t frame;
+        set_rq_color(sibling, get_rq_color(parent));
+        set_rq_color(parent, RQ_BLACK);
+        set_rq_color(get_rq_left(sibling), RQ_BLACK);
 
-  while (lo < hi)
-  {
-    if (is_virtual_address_mapped(parent_table, (uint64_t)get_PTE_address_for_page(parent_table, table, lo)))
-    {
-      frame = load_virtual_memory(parent_table, (uint64_t)get_PTE_address_for_page(parent_table, table, lo));
+        rotate_run_queue_right(parent);
 
-      map_page(context, lo, get_frame_for_page(parent_table, get_page_of_virtual_address(frame)));
+        context = run_queue;
+      }
     }
-
-    lo = lo + 1;
   }
+
+  if (context != (uint64_t *)0)
+    set_rq_color(context, RQ_BLACK);
 }
 
-void restore_context(uint64_t *context)
-{
-  uint64_t *parent_table;
-  uint64_t *vctxt;
-  uint64_t r;
-  uint64_t *pregs;
-  uint64_t *vregs;
-  uint64_t *table;
-  uint64_t lo;
-  uint64_t hi;
+// Remove a context from the run queue if it is queued
+void dequeue_context(uint64_t *context) {
+  uint64_t *successor;
+  uint64_t *child;
+  uint64_t *parent;
+  uint64_t color;
 
-  if (get_parent(context) != MY_CONTEXT)
-  {
-    // download changes in virtual context in parent address space to context
-    parent_table = get_pt(get_parent(context));
+  if (scheduler_type == SCHEDULER_MLFQ) {
+    remove_from_level(context);
 
-    vctxt = get_virtual_context(context);
+    return;
+  } else if (get_rq_color(context) == 0)
+    return;
 
-    set_pc(context, load_virtual_memory(parent_table, program_counter(vctxt)));
+  if (get_rq_left(context) == (uint64_t *)0) {
+    child  = get_rq_right(context);
+    parent = get_rq_up(context);
+    color  = get_rq_color(context);
 
-    r = 0;
+    replace_in_run_queue(context, child);
+  } else if (get_rq_right(context) == (uint64_t *)0) {
+    child  = get_rq_left(context);
+    parent = get_rq_up(context);
+    color  = get_rq_color(context);
 
-    pregs = get_regs(context);
-    vregs = (uint64_t *)load_virtual_memory(parent_table, regs(vctxt));
+    replace_in_run_queue(context, child);
+  } else {
+    successor = get_rq_right(context);
 
-    while (r < NUMBEROFREGISTERS)
-    {
-      *(pregs + r) = load_virtual_memory(parent_table, (uint64_t)(vregs + r));
+    while (get_rq_left(successor) != (uint64_t *)0)
+      successor = get_rq_left(successor);
 
-      r = r + 1;
-    }
+    child = get_rq_right(successor);
+    color = get_rq_color(successor);
 
-    set_program_break(context, load_virtual_memory(parent_table, program_break(vctxt)));
+    if (get_rq_up(successor) == context)
+      parent = successor;
+    else {
+      parent = get_rq_up(successor);
 
-    set_exception(context, load_virtual_memory(parent_table, exception(vctxt)));
-    set_fault(context, load_virtual_memory(parent_table, fault(vctxt)));
+      replace_in_run_queue(successor, child);
 
-    set_exit_code(context, load_virtual_memory(parent_table, exit_code(vctxt)));
+      set_rq_right(successor, get_rq_right(context));
+      set_rq_up(get_rq_right(successor), successor);
+    }
 
-    table = (uint64_t *)load_virtual_memory(parent_table, page_table(vctxt));
+    replace_in_run_queue(context, successor);
+
+    set_rq_left(successor, get_rq_left(context));
+    set_rq_up(get_rq_left(successor), successor);
+    set_rq_color(successor, get_rq_color(context));
+  }
 
-    // assert: virtual context page table is only mapped from beginning up and end down
+  if (color == RQ_BLACK)
+    rebalance_run_queue(child, parent);
 
-    lo = load_virtual_memory(parent_table, lowest_lo_page(vctxt));
-    hi = load_virtual_memory(parent_table, highest_lo_page(vctxt));
+  set_rq_color(context, 0);
 
-    restore_region(context, table, parent_table, lo, hi);
+  queued_contexts = queued_contexts - 1;
+  queued_weight   = queued_weight - get_weight(context);
+}
 
-    store_virtual_memory(parent_table, lowest_lo_page(vctxt), hi);
+// Change vruntime of a context, keeping the CFS run queue ordered
+void update_vruntime(uint64_t *context, uint64_t vruntime) {
+  if (get_rq_color(context) != 0) {
+    dequeue_context(context);
 
-    lo = load_virtual_memory(parent_table, lowest_hi_page(vctxt));
-    hi = load_virtual_memory(parent_table, highest_hi_page(vctxt));
+    set_vruntime(context, vruntime);
 
-    restore_region(context, table, parent_table, lo, hi);
+    enqueue_context(context);
+  } else
+    set_vruntime(context, vruntime);
+}
 
-    store_virtual_memory(parent_table, highest_hi_page(vctxt), lo);
+// Set nice level and CFS weight of a context, keeping queued weight up to date
+void renice_context(uint64_t *context, uint64_t nice) {
+  uint64_t weight;
+  uint64_t level;
 
-    // garbage collector state (only necessary if context is gced by different gcs)
+  weight = NICE0WEIGHT;
+  level  = nice;
 
-    set_used_list_head(context, (uint64_t *)load_virtual_memory(parent_table, used_list_head(vctxt)));
-    set_free_list_head(context, (uint64_t *)load_virtual_memory(parent_table, free_list_head(vctxt)));
-    set_gcs_in_period(context, load_virtual_memory(parent_table, gcs_in_period(vctxt)));
-    set_use_gc_kernel(context, load_virtual_memory(parent_table, use_gc_kernel(vctxt)));
+  while (signed_less_than(level, 0)) {
+    weight = weight * 5 / 4;
+    level  = level + 1;
   }
 
-  // restore machine state
-  pc = get_pc(context);
-  registers = get_regs(context);
-  pt = get_pt(context);
+  while (signed_less_than(0, level)) {
+    weight = weight * 4 / 5;
+    level  = level - 1;
+  }
 
-  flush_all_caches();
+  if (get_rq_color(context) != 0)
+    queued_weight = queued_weight - get_weight(context) + weight;
 
-  set_ic_all(context, get_total_number_of_instructions() - get_ic_all(context));
+  set_nice(context, nice);
+  set_weight(context, weight);
+}
 
-  // printf("DEBUG regs: gp=0x%lx sp=0x%lx ra=0x%lx pc=0x%lx\n",
-  //      *(registers+REG_GP), *(registers+REG_SP), *(registers+REG_RA), *(registers+REG_A6));
+// Instructions executed by contexts hosted by a guest kernel
+// are accounted to the guest kernel on my boot level
+void account_runtime(uint64_t *context, uint64_t instructions) {
+  while (get_parent(context) != MY_CONTEXT)
+    context = get_parent(context);
 
+  set_runtime(context, get_runtime(context) + instructions);
+  set_cpu_time(context, get_cpu_time(context) + instructions);
 }
 
-uint64_t is_code_address(uint64_t *context, uint64_t vaddr)
-{
-  // is address in code segment?
-  if (vaddr >= get_code_seg_start(context))
-    if (vaddr < get_code_seg_start(context) + get_code_seg_size(context))
-      return 1;
+// Charge accounted instructions to vruntime, scaled inversely to weight
+void charge_vruntime(uint64_t *context) {
+  uint64_t delta;
 
-  return 0;
-}
+  delta = get_runtime(context) * NICE0WEIGHT / get_weight(context);
 
-uint64_t is_data_address(uint64_t *context, uint64_t vaddr)
-{
-  // is address in data segment?
-  if (vaddr >= get_data_seg_start(context))
-    if (vaddr < get_data_seg_start(context) + get_data_seg_size(context))
-      return 1;
+  set_runtime(context, 0);
 
-  return 0;
+  update_vruntime(context, get_vruntime(context) + delta);
 }
 
-uint64_t is_stack_address(uint64_t *context, uint64_t vaddr)
-{
-  // is address in stack segment?
-  if (vaddr >= *(get_regs(context) + REG_SP))
-    if (vaddr <= HIGHESTVIRTUALADDRESS)
-      return 1;
+// Advance pass by the stride of a context for each accounted instruction
+void charge_pass(uint64_t *context) {
+  uint64_t pass;
 
-  return 0;
-}
+  pass = get_pass(context) + get_runtime(context) * (STRIDE1 / get_tickets(context));
 
-uint64_t is_heap_address(uint64_t *context, uint64_t vaddr)
-{
-  // is address in heap segment?
-  if (vaddr >= get_heap_seg_start(context))
-    if (vaddr < get_program_break(context))
-      return 1;
+  set_runtime(context, 0);
 
-  return 0;
+  if (get_rq_color(context) != 0) {
+    dequeue_context(context);
+
+    set_pass(context, pass);
+
+    enqueue_context(context);
+  } else
+    set_pass(context, pass);
 }
 
-uint64_t is_address_between_stack_and_heap(uint64_t *context, uint64_t vaddr)
-{
-  // is address between heap and stack segments?
-  if (vaddr >= get_program_break(context))
-    if (vaddr < *(get_regs(context) + REG_SP))
+uint64_t is_budget_exhausted() {
+  if (INSTRUCTIONBUDGET != 0)
+    if (charged_instructions >= INSTRUCTIONBUDGET) {
+      printf("%s: instruction budget of %lu instructions exhausted\n", selfie_name, INSTRUCTIONBUDGET);
+
       return 1;
+    }
 
   return 0;
 }
 
-uint64_t is_data_stack_heap_address(uint64_t *context, uint64_t vaddr)
-{
-  if (is_data_address(context, vaddr))
-    return 1;
-  else if (is_stack_address(context, vaddr))
-    return 1;
-  else if (is_heap_address(context, vaddr))
-    return 1;
-  else
-    return 0;
-}
+// Push a blocked or exited context onto the blocked or zombie queue
+void insert_into_state_queue(uint64_t *context) {
+  uint64_t *head;
 
-uint64_t is_valid_segment_read(uint64_t vaddr)
-{
-  if (is_data_address(current_context, vaddr))
-  {
-    data_reads = data_reads + 1;
+  if (get_blocked(context) == 1)
+    head = blocked_contexts;
+  else
+    head = zombie_contexts;
 
-    return 1;
-  }
-  else if (is_stack_address(current_context, vaddr))
-  {
-    stack_reads = stack_reads + 1;
+  set_next_in_state(context, head);
+  set_prev_in_state(context, (uint64_t *)0);
 
-    return 1;
-  }
-  else if (is_heap_address(current_context, vaddr))
-  {
-    heap_reads = heap_reads + 1;
+  if (head != (uint64_t *)0)
+    set_prev_in_state(head, context);
 
-    return 1;
-  }
+  if (get_blocked(context) == 1)
+    blocked_contexts = context;
   else
-    return 0;
+    zombie_contexts = context;
 }
 
-uint64_t is_valid_segment_write(uint64_t vaddr)
-{
-  if (is_data_address(current_context, vaddr))
-  {
-    data_writes = data_writes + 1;
-
-    return 1;
-  }
-  else if (is_stack_address(current_context, vaddr))
-  {
-    stack_writes = stack_writes + 1;
+void remove_from_state_queue(uint64_t *context) {
+  if (get_blocked(context) == 0)
+    return;
 
-    return 1;
-  }
-  else if (is_heap_address(current_context, vaddr))
-  {
-    heap_writes = heap_writes + 1;
+  if (get_next_in_state(context) != (uint64_t *)0)
+    set_prev_in_state(get_next_in_state(context), get_prev_in_state(context));
 
-    return 1;
-  }
+  if (get_prev_in_state(context) != (uint64_t *)0)
+    set_next_in_state(get_prev_in_state(context), get_next_in_state(context));
+  else if (get_blocked(context) == 1)
+    blocked_contexts = get_next_in_state(context);
   else
-    return 0;
-}
-
-// -----------------------------------------------------------------
-// ---------------------------- KERNEL -----------------------------
-// -----------------------------------------------------------------
+    zombie_contexts = get_next_in_state(context);
 
-uint64_t pavailable()
-{
-  if (free_page_frame_memory > 0)
-    return 1;
-  else if (allocated_page_frame_memory + MEGABYTE <=
-           PHYSICALMEMORYEXCESS * PHYSICALMEMORYSIZE * sizeof(uint64_t) / WORDSIZE)
-    // single word on 32-bit target occupies double word on 64-bit system
-    return 1;
-  else
-    return 0;
+  set_next_in_state(context, (uint64_t *)0);
+  set_prev_in_state(context, (uint64_t *)0);
 }
 
-uint64_t pused()
-{
-  return allocated_page_frame_memory - free_page_frame_memory;
-}
+// Move a context waiting on a semaphore or lock from the run queue to the blocked queue
+void block_context(uint64_t *context, uint64_t kind, uint64_t id, uint64_t address) {
+  dequeue_context(context);
 
-uint64_t *palloc()
-{
-  uint64_t double_for_single_word;
-  uint64_t block;
-  uint64_t frame;
+  set_blocked(context, 1);
 
-  // single word on 32-bit target occupies double word on 64-bit system
-  double_for_single_word = sizeof(uint64_t) / WORDSIZE;
+  set_wait_kind(context, kind);
+  set_wait_id(context, id);
+  set_wait_address(context, address);
 
-  // assert: PHYSICALMEMORYSIZE is equal to or a multiple of MEGABYTE
-  // assert: PAGESIZE is a factor of MEGABYTE strictly less than MEGABYTE
+  insert_into_state_queue(context);
+}
 
-  if (free_page_frame_memory == 0)
-  {
-    if (pavailable())
-    {
-      free_page_frame_memory = MEGABYTE * double_for_single_word;
+// Move an exited context to the zombie queue where it stays for its profile
+void retire_context(uint64_t *context) {
+  dequeue_context(context);
+  remove_from_state_queue(context);
 
-      // on boot level 0 allocate zeroed memory
-      block = (uint64_t)zmalloc(free_page_frame_memory);
+  set_blocked(context, 2);
 
-      allocated_page_frame_memory = allocated_page_frame_memory + free_page_frame_memory;
+  set_wait_kind(context, 0);
+  set_wait_address(context, 0);
 
-      // page frames must be page-aligned to work as page table index
-      next_page_frame = round_up(block, PAGESIZE * double_for_single_word);
+  set_completion(context, charged_instructions);
 
-      if (next_page_frame > block)
-        // losing one page frame to fragmentation
-        free_page_frame_memory = free_page_frame_memory - PAGESIZE * double_for_single_word;
-    }
-    else
-    {
-      printf("%s: palloc out of physical memory\n", selfie_name);
+  insert_into_state_queue(context);
+}
 
-      exit(EXITCODE_OUTOFPHYSICALMEMORY);
-    }
-  }
+// Print which context waits on which semaphore or lock, and who holds it
+void print_wait_for_graph() {
+  uint64_t *context;
+  uint64_t *holder;
+  uint64_t *lock;
 
-  frame = next_page_frame;
+  context = blocked_contexts;
 
-  next_page_frame = next_page_frame + PAGESIZE * double_for_single_word;
+  while (context != (uint64_t *)0) {
+    printf("%s: pid %lu waits on ", selfie_name, get_id_context(context));
 
-  free_page_frame_memory = free_page_frame_memory - PAGESIZE * double_for_single_word;
+    if (get_wait_kind(context) == WAIT_LOCK) {
+      lock = used_locks + get_wait_id(context) * LOCKENTRIES;
 
-  // strictly, touching is only necessary on boot levels higher than 0
-  return touch((uint64_t *)frame, PAGESIZE * double_for_single_word);
-}
+      printf("lock %lu at 0x%lX", get_wait_id(context), get_wait_address(context));
 
-void pfree(uint64_t *frame)
-{
-  // TODO: implement free list of page frames
-  frame = frame + 1;
-}
+      holder = find_context_by_id(get_lock_owner(lock));
 
-void map_and_store(uint64_t *context, uint64_t vaddr, uint64_t data)
-{
-  // assert: is_virtual_address_valid(vaddr, WORDSIZE) == 1
+      if (holder == (uint64_t *)0)
+        printf(" without owner\n");
+      else if (get_blocked(holder) == 2)
+        printf(" held by exited pid %lu\n", get_id_context(holder));
+      else
+        printf(" held by pid %lu\n", get_id_context(holder));
+    } else {
+      printf("semaphore %lu at 0x%lX with value %lu", get_wait_id(context), get_wait_address(context),
+        get_sem_value(used_semaphores + get_wait_id(context) * SEMAPHOREENTRIES));
 
-  if (is_virtual_address_mapped(get_pt(context), vaddr) == 0)
-    map_page(context, get_page_of_virtual_address(vaddr), (uint64_t)palloc());
+      // semaphores have no owner, lockdep knows who acquired them without waiting
+      holder = used_contexts;
 
-  store_virtual_memory(get_pt(context), vaddr, data);
-}
+      while (holder != (uint64_t *)0) {
+        if (is_lock_held(holder, get_wait_address(context)))
+          if (get_wait_address(holder) != get_wait_address(context))
+            printf(" acquired by pid %lu", get_id_context(holder));
 
-void up_load_binary(uint64_t *context)
-{
-  uint64_t baddr;
+        holder = get_next_context(holder);
+      }
 
-  // assert: e_entry is multiple of PAGESIZE and INSTRUCTIONSIZE
+      println();
+    }
 
-  set_pc(context, e_entry);
+    context = get_next_in_state(context);
+  }
+}
 
-  // setting up page table cache
+// No context is runnable, so either all contexts
+// at my boot level exited, or the blocked ones wait on each other forever
+uint64_t stop_scheduling() {
+  if (blocked_contexts == (uint64_t *)0)
+    return EXITCODE_NOERROR;
 
-  set_lowest_lo_page(context, get_page_of_virtual_address(code_start));
-  set_highest_lo_page(context, get_lowest_lo_page(context));
+  printf("%s: deadlock, no blocked context can ever wake up\n", selfie_name);
 
-  // setting up memory segments
+  print_wait_for_graph();
 
-  set_code_seg_start(context, code_start);
-  set_code_seg_size(context, code_size);
-  set_data_seg_start(context, data_start);
-  set_data_seg_size(context, data_size);
-  set_heap_seg_start(context, round_up(data_start + data_size, p_align));
-  set_program_break(context, get_heap_seg_start(context));
+  return EXITCODE_DEADLOCK;
+}
 
-  baddr = 0;
+// Unblock a context without crediting it more than half the target latency
+// of vruntime, or any pass, for the time it was blocked
+void wake_up_context(uint64_t *context) {
+  remove_from_state_queue(context);
 
-  while (baddr < code_size)
-  {
-    map_and_store(context, get_code_seg_start(context) + baddr, load_code(baddr));
+  set_blocked(context, 0);
 
-    baddr = baddr + WORDSIZE;
-  }
+  set_wait_kind(context, 0);
+  set_wait_address(context, 0);
 
-  baddr = 0;
+  if (get_vruntime(context) + SCHEDLATENCY / 2 < min_vruntime)
+    set_vruntime(context, min_vruntime - SCHEDLATENCY / 2);
 
-  while (baddr < data_size)
-  {
-    map_and_store(context, get_data_seg_start(context) + baddr, load_data(baddr));
+  if (get_pass(context) < global_pass)
+    set_pass(context, global_pass);
 
-    baddr = baddr + WORDSIZE;
-  }
+  enqueue_context(context);
 }
 
-uint64_t up_load_string(uint64_t *context, char *s, uint64_t SP)
-{
-  uint64_t bytes;
-  uint64_t i;
+// Number of instructions a context may run before the timer interrupts it,
+// CFS gives each context its weighted share of the scheduling period
+uint64_t context_timeslice(uint64_t *context) {
+  uint64_t period;
+  uint64_t timeslice;
+
+  if (scheduler_type == SCHEDULER_MLFQ) {
+    // remaining allotment on level of context
+    timeslice = level_allotment(refresh_level(context));
 
-  bytes = round_up(string_length(s) + 1, WORDSIZE);
+    if (get_runtime(context) < timeslice)
+      return timeslice - get_runtime(context);
+    else
+      return timeslice;
+  } else if (scheduler_type != SCHEDULER_CFS)
+    return TIMESLICE;
+  else if (queued_weight == 0)
+    return SCHEDLATENCY;
 
-  // allocate memory for storing string
-  SP = SP - bytes;
+  period = SCHEDLATENCY;
 
-  i = 0;
+  if (queued_contexts * MINGRANULARITY > period)
+    period = queued_contexts * MINGRANULARITY;
 
-  while (i < bytes)
-  {
-    map_and_store(context, SP + i, load_word((uint64_t *)s, i, 1));
+  timeslice = period * get_weight(context) / queued_weight;
 
-    i = i + WORDSIZE;
-  }
+  if (timeslice < MINGRANULARITY)
+    return MINGRANULARITY;
+  else
+    return timeslice;
+}
 
-  return SP;
+uint64_t level_allotment(uint64_t level) {
+  return MLFQALLOTMENT * two_to_the_power_of(level);
 }
 
-void up_load_arguments(uint64_t *context, uint64_t argc, uint64_t *argv)
-{
-  /* upload arguments like a UNIX system
+// Level of a context, which is the highest level
+// if all contexts were boosted since the level was set
+uint64_t refresh_level(uint64_t *context) {
+  if (get_level_boosts(context) != mlfq_boosts) {
+    set_level(context, 0);
+    set_level_boosts(context, mlfq_boosts);
 
-      SP
-      |
-      V
-   | argc | argv[0] | ... | argv[n] | 0 | env[0] | ... | env[m] | 0 |
+    set_runtime(context, 0);
+  }
 
-     with argc > 0, n == argc - 1, and m == 0 (that is, env is empty) */
-  uint64_t SP;
-  uint64_t *vargv;
-  uint64_t i;
+  return get_level(context);
+}
 
-  // the call stack grows top down
-  SP = VIRTUALMEMORYSIZE * GIGABYTE;
+uint64_t is_level_queued(uint64_t *context) {
+  if (get_prev_in_level(context) != (uint64_t *)0)
+    return 1;
+  else if (level_heads != (uint64_t *)0)
+    if (*(level_heads + refresh_level(context)) == (uint64_t)context)
+      return 1;
 
-  vargv = smalloc(argc * sizeof(uint64_t *));
+  return 0;
+}
 
-  i = 0;
+// Append a ready context to the queue of its MLFQ level unless it is queued already
+void append_to_level(uint64_t *context) {
+  uint64_t level;
+  uint64_t *tail;
 
-  // push program parameters onto the stack
-  while (i < argc)
-  {
-    SP = up_load_string(context, (char *)*(argv + i), SP);
+  if (level_heads == (uint64_t *)0) {
+    level_heads = zmalloc(MLFQLEVELS * sizeof(uint64_t *));
+    level_tails = zmalloc(MLFQLEVELS * sizeof(uint64_t *));
+  }
 
-    // store pointer in virtual *argv
-    *(vargv + i) = SP;
+  if (is_level_queued(context))
+    return;
 
-    i = i + 1;
-  }
+  level = refresh_level(context);
 
-  // allocate memory for termination of env table
-  SP = SP - WORDSIZE;
+  tail = (uint64_t *)*(level_tails + level);
 
-  // push null value to terminate env table
-  map_and_store(context, SP, 0);
+  set_next_in_level(context, (uint64_t *)0);
+  set_prev_in_level(context, tail);
 
-  // allocate memory for termination of argv table
-  SP = SP - WORDSIZE;
+  if (tail == (uint64_t *)0)
+    *(level_heads + level) = (uint64_t)context;
+  else
+    set_next_in_level(tail, context);
 
-  // push null value to terminate argv table
-  map_and_store(context, SP, 0);
+  *(level_tails + level) = (uint64_t)context;
 
-  // assert: i == argc
+  queued_contexts = queued_contexts + 1;
+}
 
-  // push argv table onto the stack
-  while (i > 0)
-  {
-    // allocate memory for argv table entry
-    SP = SP - WORDSIZE;
+void remove_from_level(uint64_t *context) {
+  uint64_t level;
 
-    i = i - 1;
+  if (is_level_queued(context) == 0)
+    return;
 
-    // push argv table entry
-    map_and_store(context, SP, *(vargv + i));
-  }
+  level = refresh_level(context);
 
-  // allocate memory for argc
-  SP = SP - WORDSIZE;
+  if (get_prev_in_level(context) == (uint64_t *)0)
+    *(level_heads + level) = (uint64_t)get_next_in_level(context);
+  else
+    set_next_in_level(get_prev_in_level(context), get_next_in_level(context));
 
-  // push argc
-  map_and_store(context, SP, argc);
+  if (get_next_in_level(context) == (uint64_t *)0)
+    *(level_tails + level) = (uint64_t)get_prev_in_level(context);
+  else
+    set_prev_in_level(get_next_in_level(context), get_prev_in_level(context));
 
-  // store stack pointer value in stack pointer register
-  *(get_regs(context) + REG_SP) = SP;
+  set_next_in_level(context, (uint64_t *)0);
+  set_prev_in_level(context, (uint64_t *)0);
 
-  // initialize frame pointer register for completeness (redundant)
-  *(get_regs(context) + REG_S0) = 0;
+  queued_contexts = queued_contexts - 1;
 }
 
-uint64_t handle_system_call(uint64_t *context)
-{
-  uint64_t a7;
+// Move all contexts to the highest level by splicing the level queues,
+// levels of contexts are reset when they are next refreshed
+void boost_levels() {
+  uint64_t level;
+  uint64_t *head;
+  uint64_t *tail;
 
-  set_exception(context, EXCEPTION_NOEXCEPTION);
+  level = 1;
 
-  set_ec_syscall(context, get_ec_syscall(context) + 1);
+  while (level < MLFQLEVELS) {
+    head = (uint64_t *)*(level_heads + level);
 
-  a7 = *(get_regs(context) + REG_A7);
-  //printf("Handling syscall with id: %lu\n",a7);
+    if (head != (uint64_t *)0) {
+      tail = (uint64_t *)*level_tails;
 
-  if (a7 == SYSCALL_BRK)
-  {
-    if (is_gc_enabled(context))
-      implement_gc_brk(context);
-    else
-      implement_brk(context);
-  }
-  else if (a7 == SYSCALL_READ)
-    implement_read(context);
-  else if (a7 == SYSCALL_WRITE)
-    implement_write(context);
-  else if (a7 == SYSCALL_OPENAT)
-    implement_openat(context);
-  else if (a7 == SYSCALL_DUMMY)  // dummy_syscall
-    implement_dummy_syscall(context);
-  else if (a7 == SYSCALL_COUNT_SYSCALLS) // count_syscall
-    implement_count_syscalls(context);
-  else if (a7 == SYSCALL_FORK)
-    implement_fork(context); // fork
-  else if (a7 == SYSCALL_SEM_INIT) // Semaphores
-    implement_sem_init (context);
-  else if (a7 == SYSCALL_SEM_WAIT) // Semaphores
-    implement_sem_wait (context);
-  else if (a7 == SYSCALL_SEM_POST) // Semaphores
-    implement_sem_post (context);
-  else if (a7 == SYSCALL_LOCK_INIT) // locks
-    implement_lock_init (context);
-  else if (a7 == SYSCALL_LOCK_ACQUIRE) // locks
-    implement_lock_acquire (context);
-  else if (a7 == SYSCALL_LOCK_RELEASE) // locks
-    implement_lock_release (context);
-  else if (a7 == SYSCALL_EXIT)
-  {
-    implement_exit(context);
+      if (tail == (uint64_t *)0)
+        *level_heads = (uint64_t)head;
+      else {
+        set_next_in_level(tail, head);
+        set_prev_in_level(head, tail);
+      }
 
-    // Mark context as exited by setting blocked flag to special value
-    set_blocked(context, 2); // 0=ready, 1=blocked, 2=exited
-    
-    return DONOTEXIT;
-  } else
-  {
-    printf("%s: unknown system call %lu\n", selfie_name, a7);
+      *level_tails = *(level_tails + level);
 
-    set_exit_code(context, EXITCODE_UNKNOWNSYSCALL);
+      *(level_heads + level) = 0;
+      *(level_tails + level) = 0;
+    }
 
-    return EXIT;
+    level = level + 1;
   }
 
-  return DONOTEXIT;
-}
-
-uint64_t handle_page_fault(uint64_t *context)
-{
-  uint64_t page;
+  mlfq_boosts = mlfq_boosts + 1;
 
-  set_exception(context, EXCEPTION_NOEXCEPTION);
+  last_boost = charged_instructions;
+}
 
-  set_ec_page_fault(context, get_ec_page_fault(context) + 1);
+// Demote a context that used up the allotment of its level
+void charge_level(uint64_t *context) {
+  uint64_t level;
+  uint64_t queued;
 
-  page = get_fault(context);
+  level = refresh_level(context);
 
-  if (pavailable())
-  {
-    // TODO: reuse frames
-    map_page(context, page, (uint64_t)palloc());
+  if (get_runtime(context) >= level_allotment(level)) {
+    queued = is_level_queued(context);
 
-    if (is_heap_address(context, get_virtual_address_of_page_start(page)))
-      set_mc_mapped_heap(context, get_mc_mapped_heap(context) + PAGESIZE);
+    if (queued)
+      remove_from_level(context);
 
-    return DONOTEXIT;
-  }
-  else
-  {
-    printf("%s: page fault at 0x%lX out of physical memory\n", selfie_name, page);
+    if (level + 1 < MLFQLEVELS)
+      set_level(context, level + 1);
 
-    set_exit_code(context, EXITCODE_OUTOFPHYSICALMEMORY);
+    set_runtime(context, 0);
 
-    return EXIT;
+    if (queued)
+      append_to_level(context);
   }
 }
 
-uint64_t handle_division_by_zero(uint64_t *context)
-{
-  set_exception(context, EXCEPTION_NOEXCEPTION);
-
-  if (record)
-  {
-    printf("%s: division by zero, replaying...\n", selfie_name);
+// Select the first context on level and move it to the end of the level queue
+uint64_t *rotate_level(uint64_t level) {
+  uint64_t *context;
 
-    replay_trace();
+  if (level_heads == (uint64_t *)0)
+    return (uint64_t *)0;
 
-    set_exit_code(context, EXITCODE_NOERROR);
-  }
-  else
-  {
-    printf("%s: division by zero\n", selfie_name);
+  context = (uint64_t *)*(level_heads + level);
 
-    set_exit_code(context, EXITCODE_DIVISIONBYZERO);
+  if (context != (uint64_t *)0) {
+    remove_from_level(context);
+    append_to_level(context);
   }
 
-  return EXIT;
+  return context;
 }
 
-uint64_t handle_timer(uint64_t *context)
-{
-  set_exception(context, EXCEPTION_NOEXCEPTION);
+// Select the first context from the highest non-empty level
+// and move it to the end of its level (round-robin)
+uint64_t *select_mlfq_context() {
+  uint64_t level;
+  uint64_t *context;
 
-  set_ec_timer(context, get_ec_timer(context) + 1);
+  if (level_heads == (uint64_t *)0)
+    return (uint64_t *)0;
 
-  return DONOTEXIT;
-}
+  if (charged_instructions - last_boost >= MLFQBOOST)
+    boost_levels();
 
-// -------------------------------------------------------------------------
-// ------------------------- SCHEDULER FUNCTIONS ---------------------------
-// -------------------------------------------------------------------------
+  level = 0;
 
-// Simple pseudo-random number generator (Linear Congruential Generator)
-uint64_t simple_rand() {
-  uint64_t temp;
-  
-  temp = random_seed * 1103515245;
-  temp = temp + 12345;
-  random_seed = temp % 2147483648; // 0x7FFFFFFF + 1
-  
-  return random_seed;
+  while (level < MLFQLEVELS) {
+    context = rotate_level(level);
+
+    if (context != (uint64_t *)0)
+      return context;
+
+    level = level + 1;
+  }
+
+  return (uint64_t *)0;
 }
 
-// Count runnable contexts in the used_contexts list
-uint64_t count_runnable_contexts() {
+uint64_t *first_queued_context() {
   uint64_t *context;
-  uint64_t count;
 
-  context = used_contexts;
-  count = 0;
+  context = run_queue;
 
-  while (context != (uint64_t *)0) {
-    if (get_blocked(context) == 0)
-      count = count + 1;
-    
-    context = get_next_context(context);
-  }
+  if (context != (uint64_t *)0)
+    while (get_rq_left(context) != (uint64_t *)0)
+      context = get_rq_left(context);
 
-  return count;
+  return context;
 }
 
-// Select a random runnable context from the list
-uint64_t *select_random_context() {
-  uint64_t num_runnable;
-  uint64_t random_index;
-  uint64_t *context;
-  uint64_t i;
+// In-order successor of context in the CFS run queue
+uint64_t *next_queued_context(uint64_t *context) {
+  uint64_t *parent;
 
-  num_runnable = count_runnable_contexts();
+  if (get_rq_right(context) != (uint64_t *)0) {
+    context = get_rq_right(context);
 
-  if (num_runnable == 0)
-    return (uint64_t *)0;
+    while (get_rq_left(context) != (uint64_t *)0)
+      context = get_rq_left(context);
 
-  random_index = simple_rand();
-  random_index = random_index % num_runnable;
+    return context;
+  }
 
-  context = used_contexts;
-  i = 0;
+  parent = get_rq_up(context);
 
-  while (context != (uint64_t *)0) {
-    if (get_blocked(context) == 0) {
-      if (i == random_index)
-        return context;
-      i = i + 1;
-    }
-    context = get_next_context(context);
+  while (parent != (uint64_t *)0) {
+    if (context != get_rq_right(parent))
+      return parent;
+
+    context = parent;
+    parent  = get_rq_up(context);
   }
 
   return (uint64_t *)0;
 }
 
-// Select context with minimum vruntime (Completely Fair Scheduler)
-uint64_t *select_cfs_context() {
-  uint64_t *context;
-  uint64_t *min_context;
-  uint64_t min_vruntime;
+// Select context with minimum vruntime (Completely Fair Scheduler) or pass
+// (stride scheduling), the run queue only holds ready contexts
+uint64_t *select_queued_context() {
+  return first_queued_context();
+}
 
-  context = used_contexts;
-  min_context = (uint64_t *)0;
-  min_vruntime = UINT64_MAX;
+// Select the first context queued after context, wrapping around at the
+// end of the run queue; without vruntime all keys are equal and the run
+// queue orders contexts by descending PID, just like used_contexts (round-robin)
+uint64_t *select_queued_context_after(uint64_t *context) {
+  uint64_t *node;
+  uint64_t *next;
 
-  while (context != (uint64_t *)0) {
-    if (get_blocked(context) == 0) {
-      if (get_vruntime(context) < min_vruntime) {
-        min_vruntime = get_vruntime(context);
-        min_context = context;
-      }
-    }
-    context = get_next_context(context);
+  next = (uint64_t *)0;
+
+  if (context != (uint64_t *)0) {
+    node = run_queue;
+
+    // context may not be queued, so search for its successor by key
+    while (node != (uint64_t *)0)
+      if (is_queued_before(context, node)) {
+        next = node;
+        node = get_rq_left(node);
+      } else
+        node = get_rq_right(node);
   }
 
-  return min_context;
+  if (next != (uint64_t *)0)
+    return next;
+  else
+    return first_queued_context();
 }
 
 uint64_t handle_exception(uint64_t *context)
@@ -14172,19 +19278,104 @@ uint64_t handle_exception(uint64_t *context)
   }
 }
 
+// Select the next context after from_context according to the scheduler,
+// returns null if no context is ready
+uint64_t *schedule_context(uint64_t *from_context) {
+  uint64_t *to_context;
+
+  if (scheduler_type == SCHEDULER_RANDOM) {
+    // Random Scheduler
+    to_context = select_random_context();
+    
+    if (debug_scheduler) {
+      if (to_context != (uint64_t *)0)
+        printf("[SCHEDULER] Random: selecting process PID=%lu\n", get_id_context(to_context));
+    }
+  } else if (scheduler_type == SCHEDULER_CFS) {
+    // Completely Fair Scheduler (CFS)
+    if (from_context != (uint64_t *)0) {
+      // charge executed instructions by weight before selecting,
+      // so that the context that just ran is queued by its new vruntime
+      charge_vruntime(from_context);
+
+      if (debug_scheduler)
+        printf("[SCHEDULER] CFS: updated PID=%lu vruntime to %lu\n",
+               get_id_context(from_context), get_vruntime(from_context));
+    }
+
+    to_context = select_queued_context();
+    
+    if (to_context != (uint64_t *)0)
+      if (get_vruntime(to_context) > min_vruntime)
+        min_vruntime = get_vruntime(to_context);
+
+    if (debug_scheduler) {
+      if (to_context != (uint64_t *)0)
+        printf("[SCHEDULER] CFS: selecting process PID=%lu with vruntime=%lu\n", 
+               get_id_context(to_context), get_vruntime(to_context));
+    }
+  } else if (scheduler_type == SCHEDULER_STRIDE) {
+    // Stride scheduling
+    if (from_context != (uint64_t *)0)
+      charge_pass(from_context);
+
+    to_context = select_queued_context();
+
+    if (to_context != (uint64_t *)0)
+      if (get_pass(to_context) > global_pass)
+        global_pass = get_pass(to_context);
+
+    if (debug_scheduler) {
+      if (to_context != (uint64_t *)0)
+        printf("[SCHEDULER] Stride: selecting process PID=%lu with pass=%lu\n",
+               get_id_context(to_context), get_pass(to_context));
+    }
+  } else if (scheduler_type == SCHEDULER_MLFQ) {
+    // Multi-Level Feedback Queue (MLFQ)
+    if (from_context != (uint64_t *)0)
+      charge_level(from_context);
+
+    to_context = select_mlfq_context();
+
+    if (debug_scheduler) {
+      if (to_context != (uint64_t *)0)
+        printf("[SCHEDULER] MLFQ: selecting process PID=%lu at level %lu\n",
+               get_id_context(to_context), get_level(to_context));
+    }
+  } else {
+    // Round-Robin Scheduler (default) selects the next ready context
+    // after from_context in the order of used_contexts
+    to_context = select_queued_context_after(from_context);
+
+    if (debug_scheduler)
+      if (from_context != (uint64_t *)0)
+        if (to_context != (uint64_t *)0)
+          printf("[SCHEDULER] Round-Robin: switching from PID=%lu to PID=%lu\n",
+                 get_id_context(from_context), get_id_context(to_context));
+  }
+
+  return to_context;
+}
+
 uint64_t mipster(uint64_t *to_context)
 {
   uint64_t timeout;
+  uint64_t charged;
   uint64_t *from_context;
-  uint64_t *start_ctx;
-  uint64_t all_done;
 
-  timeout = TIMESLICE;
+  timeout = context_timeslice(to_context);
 
   while (1)
   {
+    charged = charged_instructions;
+
     from_context = mipster_switch(to_context, timeout);
 
+    account_runtime(to_context, charged_instructions - charged);
+
+    if (is_budget_exhausted())
+      return EXITCODE_NOERROR;
+
     if (get_parent(from_context) != MY_CONTEXT)
     {
       // switch to parent which is in charge of handling exceptions
@@ -14196,142 +19387,45 @@ uint64_t mipster(uint64_t *to_context)
       return get_exit_code(from_context);
     else
     {
-      // Scheduler selection
-      if (scheduler_type == SCHEDULER_RANDOM) {
-        // Random Scheduler
-        to_context = select_random_context();
-        
-        if (debug_scheduler) {
-          if (to_context != (uint64_t *)0)
-            printf("[SCHEDULER] Random: selecting process PID=%lu\n", get_id_context(to_context));
-        }
-        
-        if (to_context == (uint64_t *)0) {
-          // No runnable contexts, check if all are terminated
-          all_done = 1;
-          to_context = used_contexts;
-          
-          while (to_context != (uint64_t *)0) {
-            if (get_blocked(to_context) != 2) {
-              all_done = 0;
-              to_context = (uint64_t *)0; // break
-            } else {
-              to_context = get_next_context(to_context);
-            }
-          }
-          
-          if (all_done)
-            return EXITCODE_NOERROR;
-          else
-            to_context = used_contexts; // deadlock, but continue
-        }
-      } else if (scheduler_type == SCHEDULER_CFS) {
-        // Completely Fair Scheduler (CFS)
-        to_context = select_cfs_context();
-        
-        if (debug_scheduler) {
-          if (to_context != (uint64_t *)0)
-            printf("[SCHEDULER] CFS: selecting process PID=%lu with vruntime=%lu\n", 
-                   get_id_context(to_context), get_vruntime(to_context));
-        }
-        
-        if (to_context == (uint64_t *)0) {
-          // No runnable contexts, check if all are terminated
-          all_done = 1;
-          to_context = used_contexts;
-          
-          while (to_context != (uint64_t *)0) {
-            if (get_blocked(to_context) != 2) {
-              all_done = 0;
-              to_context = (uint64_t *)0; // break
-            } else {
-              to_context = get_next_context(to_context);
-            }
-          }
-          
-          if (all_done)
-            return EXITCODE_NOERROR;
-          else
-            to_context = used_contexts; // deadlock, but continue
-        }
-      } else {
-        // Round-Robin Scheduler (default)
-        to_context = get_next_context(from_context);
-        if (to_context == (uint64_t *)0)
-          to_context = used_contexts;
-
-        start_ctx = to_context;
-
-        while (get_blocked(to_context) >= 1) { // Bloqueado o terminado/zombie/no ruannable
-          to_context = get_next_context(to_context);
-          if (to_context == (uint64_t *)0)//Si llegamos a null, volvemos al inicio de la lista
-            to_context = used_contexts;
-          
-          
-          if (to_context == start_ctx) { // Hicimos un recorridos circular y todos los procesos están terminados o estado no runnable
-            all_done = 1;
-            
-            while (to_context != (uint64_t *)0) {
-              if (get_blocked(to_context) != 2) {
-                all_done = 0;
-                to_context = (uint64_t *)0; // break
-              } else {
-                to_context = get_next_context(to_context);
-              }
-            }
-            
-            if (all_done)
-              return EXITCODE_NOERROR;
-            else
-              to_context = start_ctx; // deadlock, but continue
-          }
-        }
-        
-        if (debug_scheduler)
-          printf("[SCHEDULER] Round-Robin: switching from PID=%lu to PID=%lu\n", 
-                 get_id_context(from_context), get_id_context(to_context));
-      }
+      to_context = schedule_context(from_context);
 
-      // Update vruntime for CFS (increment by TIMESLICE)
-      if (scheduler_type == SCHEDULER_CFS) {
-        set_vruntime(from_context, get_vruntime(from_context) + TIMESLICE);
-        
-        if (debug_scheduler)
-          printf("[SCHEDULER] CFS: updated PID=%lu vruntime to %lu\n", 
-                 get_id_context(from_context), get_vruntime(from_context));
-      }
+      if (to_context == (uint64_t *)0)
+        return stop_scheduling();
 
-      timeout = TIMESLICE;
+      timeout = context_timeslice(to_context);
     }
   }
 }
 
 uint64_t hypster(uint64_t *to_context)
 {
+  uint64_t timeout;
+  uint64_t charged;
   uint64_t *from_context;
 
   while (1)
   {
-    from_context = hypster_switch(to_context, TIMESLICE);
+    timeout = context_timeslice(to_context);
+
+    charged = charged_instructions;
+
+    from_context = hypster_switch(to_context, timeout);
+
+    if (is_boot_level_zero())
+      account_runtime(to_context, charged_instructions - charged);
+    else
+      // instructions are executed and counted by my host
+      account_runtime(to_context, timeout);
 
     if (handle_exception(from_context) == EXIT)
-    {
-      // Si un contexto sale, lo eliminamos de la lista
-      used_contexts = delete_context(from_context, used_contexts);
-      
-      // Si ya no hay más contextos, terminamos
-      if (used_contexts == (uint64_t *)0)
-        return get_exit_code(from_context);
-      
-      // Continuar con el siguiente contexto
-      to_context = used_contexts;
-    }
+      return get_exit_code(from_context);
     else
     {
-      // Round-robin scheduling: pasar al siguiente contexto
-      to_context = get_next_context(from_context);
+      // exited contexts remain as zombies and are skipped by the scheduler
+      to_context = schedule_context(from_context);
+
       if (to_context == (uint64_t *)0)
-        to_context = used_contexts;
+        return stop_scheduling();
     }
   }
 }
@@ -14425,20 +19519,26 @@ uint64_t minmob(uint64_t *to_context)
     }
     else
     {
-      // minster and mobster do not handle page faults
+      // minster and mobster do not handle page faults on unmapped pages
       if (get_exception(from_context) == EXCEPTION_PAGEFAULT)
-      {
-        printf("%s: context %s threw uncaught exception: ", selfie_name, get_name(from_context));
-        print_exception(get_exception(from_context), get_fault(from_context));
-        println();
+        if (is_page_mapped(get_pt(from_context), get_fault(from_context)) == 0)
+        {
+          printf("%s: context %s threw uncaught exception: ", selfie_name, get_name(from_context));
+          print_exception(get_exception(from_context), get_fault(from_context));
+          println();
 
-        return EXITCODE_UNCAUGHTEXCEPTION;
-      }
-      else if (handle_exception(from_context) == EXIT)
+          return EXITCODE_UNCAUGHTEXCEPTION;
+        }
+
+      // stores into shared read-only frames are handled by copying
+      if (handle_exception(from_context) == EXIT)
         return get_exit_code(from_context);
 
-      // TODO: scheduler should go here
-      to_context = from_context;
+      // exited contexts are not run again
+      to_context = schedule_context(from_context);
+
+      if (to_context == (uint64_t *)0)
+        return stop_scheduling();
 
       timeout = TIMESLICE;
     }
@@ -14602,6 +19702,241 @@ void boot_loader(uint64_t *context)
   //      get_name(context));
 }
 
+uint64_t hash_code()
+{
+  uint64_t hash;
+  uint64_t caddr;
+
+  hash = 0;
+
+  caddr = 0;
+
+  while (caddr < code_size)
+  {
+    // wrapping multiplicative hash over all instructions of loaded binary
+    hash = hash * 31 + load_instruction(caddr);
+
+    caddr = caddr + INSTRUCTIONSIZE;
+  }
+
+  return hash;
+}
+
+void save_snapshot(uint64_t *context)
+{
+  uint64_t fd;
+  uint64_t *header;
+  uint64_t *index;
+  uint64_t index_size;
+  uint64_t frame_size;
+  uint64_t number_of_pages;
+  uint64_t page;
+  uint64_t i;
+
+  // single word on 32-bit target occupies double word on 64-bit system
+  frame_size = PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
+
+  header = zmalloc(PAGESIZE);
+
+  index = smalloc(NUMBEROFPAGES * sizeof(uint64_t));
+
+  number_of_pages = 0;
+
+  page = 0;
+
+  while (page < NUMBEROFPAGES)
+  {
+    if (is_page_mapped(get_pt(context), page) + is_page_swapped(get_pt(context), page) > 0)
+    {
+      *(index + number_of_pages) = page;
+
+      number_of_pages = number_of_pages + 1;
+    }
+
+    page = page + 1;
+  }
+
+  index_size = round_up(number_of_pages * sizeof(uint64_t), PAGESIZE);
+
+  index = touch(index, index_size);
+
+  i = number_of_pages;
+
+  while (i < index_size / sizeof(uint64_t))
+  {
+    // zero padding of page index
+    *(index + i) = 0;
+
+    i = i + 1;
+  }
+
+  *header       = SNAPSHOTMAGIC;
+  *(header + 1) = WORDSIZE;
+  *(header + 2) = get_pc(context);
+  *(header + 3) = get_code_seg_start(context);
+  *(header + 4) = get_code_seg_size(context);
+  *(header + 5) = get_data_seg_start(context);
+  *(header + 6) = get_data_seg_size(context);
+  *(header + 7) = get_heap_seg_start(context);
+  *(header + 8) = get_program_break(context);
+  *(header + 9) = number_of_pages;
+
+  *(header + SNAPSHOTCODEHASH) = hash_code();
+
+  i = 0;
+
+  while (i < NUMBEROFREGISTERS)
+  {
+    *(header + SNAPSHOTREGISTERS + i) = *(get_regs(context) + i);
+
+    i = i + 1;
+  }
+
+  // assert: snapshot_name is mapped and not longer than MAX_FILENAME_LENGTH
+
+  fd = open_write_only(snapshot_name, S_IRUSR_IWUSR_IXUSR_IRGRP_IXGRP_IROTH_IXOTH);
+
+  if (signed_less_than(fd, 0))
+  {
+    printf("%s: could not create snapshot file %s\n", selfie_name, snapshot_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  if (write(fd, header, PAGESIZE) != PAGESIZE)
+  {
+    printf("%s: could not write header of snapshot file %s\n", selfie_name, snapshot_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  if (write(fd, index, index_size) != index_size)
+  {
+    printf("%s: could not write page index of snapshot file %s\n", selfie_name, snapshot_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  i = 0;
+
+  while (i < number_of_pages)
+  {
+    // frames are written as is, without going through virtual memory
+    if (write(fd, get_page_content(context, *(index + i)), frame_size) != frame_size)
+    {
+      printf("%s: could not write frames of snapshot file %s\n", selfie_name, snapshot_name);
+
+      exit(EXITCODE_IOERROR);
+    }
+
+    i = i + 1;
+  }
+
+  printf("%s: %lu pages of context %s saved after %lu timeslices into snapshot file %s\n", selfie_name,
+    number_of_pages,
+    get_name(context),
+    snapshot_timeslices,
+    snapshot_name);
+}
+
+void restore_snapshot(uint64_t *context)
+{
+  uint64_t fd;
+  uint64_t *header;
+  uint64_t *index;
+  uint64_t index_size;
+  uint64_t frame_size;
+  uint64_t number_of_pages;
+  uint64_t *frame;
+  uint64_t i;
+
+  frame_size = PAGESIZE * (sizeof(uint64_t) / WORDSIZE);
+
+  // assert: restore_name is mapped and not longer than MAX_FILENAME_LENGTH
+
+  fd = open_read_only(restore_name);
+
+  if (signed_less_than(fd, 0))
+  {
+    printf("%s: could not open snapshot file %s\n", selfie_name, restore_name);
+
+    exit(EXITCODE_IOERROR);
+  }
+
+  header = touch(smalloc(PAGESIZE), PAGESIZE);
+
+  if (sign_extend(read(fd, header, PAGESIZE), SYSCALL_BITWIDTH) == PAGESIZE)
+    if (*header == SNAPSHOTMAGIC)
+      if (*(header + 1) == WORDSIZE)
+        // snapshot must have been taken of the loaded binary
+        if (*(header + 4) == code_size)
+          if (*(header + SNAPSHOTCODEHASH) == hash_code())
+          {
+            number_of_pages = *(header + 9);
+
+            index_size = round_up(number_of_pages * sizeof(uint64_t), PAGESIZE);
+
+            index = touch(smalloc(index_size), index_size);
+
+            if (sign_extend(read(fd, index, index_size), SYSCALL_BITWIDTH) == index_size)
+            {
+              set_pc(context, *(header + 2));
+
+              set_code_seg_start(context, *(header + 3));
+              set_code_seg_size(context, *(header + 4));
+              set_data_seg_start(context, *(header + 5));
+              set_data_seg_size(context, *(header + 6));
+              set_heap_seg_start(context, *(header + 7));
+
+              // program break determines page table caching in map_page
+              set_program_break(context, *(header + 8));
+
+              i = 0;
+
+              while (i < NUMBEROFREGISTERS)
+              {
+                *(get_regs(context) + i) = *(header + SNAPSHOTREGISTERS + i);
+
+                // all registers are initialized by snapshot
+                *(writes_per_register + i) = 1;
+
+                i = i + 1;
+              }
+
+              i = 0;
+
+              while (i < number_of_pages)
+              {
+                frame = palloc();
+
+                if (sign_extend(read(fd, frame, frame_size), SYSCALL_BITWIDTH) != frame_size)
+                {
+                  printf("%s: failed to read frames from snapshot file %s\n", selfie_name, restore_name);
+
+                  exit(EXITCODE_IOERROR);
+                }
+
+                map_page(context, *(index + i), (uint64_t)frame);
+
+                i = i + 1;
+              }
+
+              set_name(context, increment_boot_level_prefix(selfie_name, binary_name));
+
+              printf("%s: %lu pages of context %s restored from snapshot file %s\n", selfie_name,
+                number_of_pages,
+                get_name(context),
+                restore_name);
+
+              return;
+            }
+          }
+
+  printf("%s: failed to restore snapshot of %s from file %s\n", selfie_name, binary_name, restore_name);
+
+  exit(EXITCODE_IOERROR);
+}
+
 uint64_t selfie_run(uint64_t machine)
 {
   uint64_t exit_code;
@@ -14645,6 +19980,30 @@ uint64_t selfie_run(uint64_t machine)
 
     machine = MIPSTER;
   }
+  else if (machine == BIPSTER)
+  {
+    basic_blocks = 1;
+
+    translated_blocks = 0;
+    hot_traces = 0;
+    executed_blocks = 0;
+    chained_blocks = 0;
+
+    fused_pops = 0;
+    fused_constants = 0;
+    fused_pushes = 0;
+
+    translated_block_list = (uint64_t *)0;
+
+    machine = MIPSTER;
+  }
+
+  if (debug)
+    // debugger and replay engine need the profiling variant
+    lean = 0;
+  else if (L1_CACHE_ENABLED)
+    // so does cache simulation
+    lean = 0;
 
   reset_interpreter();
   reset_profiler();
@@ -14656,7 +20015,11 @@ uint64_t selfie_run(uint64_t machine)
 
   // assert: number_of_remaining_arguments() > 0
 
-  boot_loader(current_context);
+  if (restore_name != (char *)0)
+    // warm start from snapshot, ignoring remaining arguments
+    restore_snapshot(current_context);
+  else
+    boot_loader(current_context);
 
   // current_context is ready to run
 
@@ -14684,6 +20047,9 @@ uint64_t selfie_run(uint64_t machine)
       printf("not reusing memory");
   }
 
+  if (lean)
+    printf(", without profiling");
+
   if (debug)
   {
     if (record)
@@ -14717,7 +20083,8 @@ uint64_t selfie_run(uint64_t machine)
          binary_name,
          sign_extend(exit_code, SYSCALL_BITWIDTH));
 
-  print_profile();
+  if (lean == 0)
+    print_profile();
 
   run = 0;
 
@@ -14726,6 +20093,10 @@ uint64_t selfie_run(uint64_t machine)
   debug_syscalls = 0;
   debug = 0;
 
+  lean = 0;
+
+  basic_blocks = 0;
+
   printf("%s: ################################################################################\n", selfie_name);
 
   return exit_code;
@@ -14780,6 +20151,13 @@ uint64_t selfie_run_mipsterOS(uint64_t machine){ // process_lab
     machine = MIPSTER;
   }
 
+  if (debug)
+    // debugger and replay engine need the profiling variant
+    lean = 0;
+  else if (L1_CACHE_ENABLED)
+    // so does cache simulation
+    lean = 0;
+
   reset_interpreter();
   reset_profiler();
   reset_microkernel();
@@ -14819,6 +20197,9 @@ uint64_t selfie_run_mipsterOS(uint64_t machine){ // process_lab
       printf("not reusing memory");
   }
 
+  if (lean)
+    printf(", without profiling");
+
   if (debug)
   {
     if (record)
@@ -14852,7 +20233,8 @@ uint64_t selfie_run_mipsterOS(uint64_t machine){ // process_lab
          binary_name,
          sign_extend(exit_code, SYSCALL_BITWIDTH));
 
-  print_profile();
+  if (lean == 0)
+    print_profile();
 
   run = 0;
 
@@ -14861,6 +20243,8 @@ uint64_t selfie_run_mipsterOS(uint64_t machine){ // process_lab
   debug_syscalls = 0;
   debug = 0;
 
+  lean = 0;
+
   printf("%s: ################################################################################\n", selfie_name);
 
   return exit_code;
@@ -14920,7 +20304,8 @@ uint64_t no_or_bad_or_more_arguments(uint64_t exit_code)
 
 void print_synopsis(char *extras)
 {
-  printf("%s: usage: selfie [ -scheduler { rr | random | cfs } ] { -c { source } | -o binary | ( -s | -S ) assembly | -l binary }%s\n", selfie_name, extras);
+  printf("%s: usage: selfie [ -scheduler { rr | random | cfs | mlfq | stride } ] ", selfie_name);
+  printf("{ -c { source } | -o binary | ( -s | -S ) assembly | -l binary }%s\n", extras);
 }
 
 // -----------------------------------------------------------------
@@ -14986,6 +20371,8 @@ uint64_t selfie(uint64_t extras)
           return selfie_run(MOBSTER);
         else if (string_compare(argument, "-L1"))
           return selfie_run(CAPSTER);
+        else if (string_compare(argument, "-bb"))
+          return selfie_run(BIPSTER);
         else if (string_compare(argument, "-x")) // process_lab 
           return selfie_run_mipsterOS(MIPSTER);
         else if (string_compare(argument, "-z"))
@@ -15058,6 +20445,10 @@ void experimental_features()
       scheduler_type = SCHEDULER_RANDOM;
     else if (string_compare(argument, "cfs"))
       scheduler_type = SCHEDULER_CFS;
+    else if (string_compare(argument, "mlfq"))
+      scheduler_type = SCHEDULER_MLFQ;
+    else if (string_compare(argument, "stride"))
+      scheduler_type = SCHEDULER_STRIDE;
     else {
       printf("%s: unknown scheduler type '%s', using round-robin\n", selfie_name, argument);
       scheduler_type = SCHEDULER_ROUND_ROBIN;
@@ -15065,6 +20456,121 @@ void experimental_features()
 
     get_argument();
   }
+  else if (string_compare(argument, "-lean"))
+  {
+    // run without any profiling
+    lean = 1;
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-snapshot"))
+  {
+    // save snapshot of running context after number of timeslices
+    snapshot_name = get_argument();
+
+    get_argument();
+
+    snapshot_timeslices = atoi(argument);
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-restore"))
+  {
+    restore_name = get_argument();
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-pt"))
+  {
+    // number of page table levels
+    get_argument();
+
+    if (atoi(argument) == 1)
+      PAGETABLETREE = 0;
+    else if (atoi(argument) == 3)
+      PAGETABLETREE = 2;
+    else
+      PAGETABLETREE = 1;
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-superpages"))
+  {
+    // superpages require three-level page tables
+    PAGETABLETREE = 2;
+    SUPERPAGES    = 1;
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-vm"))
+  {
+    // gigabytes of virtual memory, at most 4GB on 32-bit targets
+    get_argument();
+
+    VIRTUALMEMORYSIZE = atoi(argument);
+
+    if (VIRTUALMEMORYSIZE == 0)
+      VIRTUALMEMORYSIZE = 4;
+
+    init_target();
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-swap"))
+  {
+    // replacement policy for swapping pages out when physical memory is exhausted
+    get_argument();
+
+    USAGEBITS = 1;
+
+    if (string_compare(argument, "off"))
+    {
+      swap_policy = SWAPOFF;
+
+      USAGEBITS = 0;
+    }
+    else if (string_compare(argument, "fifo"))
+      swap_policy = SWAPFIFO;
+    else if (string_compare(argument, "clock"))
+      swap_policy = SWAPCLOCK;
+    else if (string_compare(argument, "lru"))
+      swap_policy = SWAPLRU;
+    else
+    {
+      printf("%s: unknown replacement policy '%s', using clock\n", selfie_name, argument);
+
+      swap_policy = SWAPCLOCK;
+    }
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-ksm"))
+  {
+    // number of timer interrupts between scans for identical pages
+    get_argument();
+
+    KSMINTERVAL = atoi(argument);
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-faultaround"))
+  {
+    // number of pages mapped ahead on each page fault
+    get_argument();
+
+    FAULTAROUND = atoi(argument);
+
+    get_argument();
+  }
+  else if (string_compare(argument, "-budget"))
+  {
+    // number of instructions after which mipster stops
+    get_argument();
+
+    INSTRUCTIONBUDGET = atoi(argument);
+
+    get_argument();
+  }
   else if (string_compare(argument, "-debug-scheduler"))
   {
     debug_scheduler = 1;
@@ -15100,11 +20606,14 @@ int main(int argc, char **argv)
   init_selfie((uint64_t)argc, (uint64_t *)argv);
 
   init_library();
+
+  printf("%s: This is Isaac Vera's Selfie!\n", selfie_name); //LAB_0
+
   init_system();
   init_target();
   init_kernel();
 
   exit_code = selfie(0);
 
-  return exit_selfie(exit_code, " [ ( -m | -d | -r | -y | -x <number> | -z <number> ) 0-4096 ... ]");
+  return exit_selfie(exit_code, " [ ( -m | -bb | -d | -r | -y | -x <number> | -z <number> ) 0-4096 ... ]");
 }
\ No newline at end of file